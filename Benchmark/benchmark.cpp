@@ -0,0 +1,173 @@
+// Benchmark suite for the ray tracer, run without a window. Times the inner loops on their own, and
+// loading and rendering each model of the OBJ corpus from fixed views, printing the results and
+// writing them as JSON. Given the JSON of an earlier run as a baseline, it fails if the measurements
+// have got slower on average by more than a tolerance, so changes can be accepted or rejected on
+// their performance
+
+#include <stdlib.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include "microbenchmarks.h"
+#include "scenebenchmarks.h"
+#include "BVH.h"
+#include "traversalstats.h"
+
+static std::string DIROPTION = "--dir=";
+static std::string JSONOPTION = "--json=";
+static std::string BASELINEOPTION = "--baseline=";
+static std::string TOLERANCEOPTION = "--tolerance=";
+static std::string REPEATSOPTION = "--repeats=";
+static std::string MICROOPTION = "--micro=";
+static std::string SCENESOPTION = "--scenes=";
+
+// Directory the OBJ files are loaded from, as for the renderer
+static std::string directory = "C:\\Users\\Mirrorworld\\Desktop\\NEA\\OBJ files\\";
+// OBJ files in the directory to benchmark, or empty for all of them
+static std::vector<std::string> filenames;
+// File the results are written to as JSON, empty to only print them
+static std::string jsonPath;
+// JSON written by an earlier run to compare against, empty for no comparison
+static std::string baselinePath;
+// Fraction the metrics may be slower than the baseline by on average before the run fails, allowing for noise
+static double tolerance = 0.05;
+static int repeats = 3;
+static bool runsMicro = true;
+static bool runsScenes = true;
+
+// Read an 'on' or 'off' option value
+static bool parseSwitch(const std::string& value, const char* name, bool& out) {
+	if (value == "on") out = true;
+	else if (value == "off") out = false;
+	else {
+		std::cout << name << " must be 'on' or 'off'\n";
+		return false;
+	}
+	return true;
+}
+
+static bool parseArgs(int argc, char *argv[]) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.compare(0, DIROPTION.size(), DIROPTION) == 0) {
+			directory = arg.substr(DIROPTION.size());
+			if (!directory.empty() && directory.back() != '/' && directory.back() != '\\') directory += '/';
+		}
+		else if (arg.compare(0, JSONOPTION.size(), JSONOPTION) == 0) {
+			jsonPath = arg.substr(JSONOPTION.size());
+		}
+		else if (arg.compare(0, BASELINEOPTION.size(), BASELINEOPTION) == 0) {
+			baselinePath = arg.substr(BASELINEOPTION.size());
+		}
+		else if (arg.compare(0, TOLERANCEOPTION.size(), TOLERANCEOPTION) == 0) {
+			char* end;
+			tolerance = strtod(argv[i] + TOLERANCEOPTION.size(), &end) / 100.0;
+			if (*end != '\0' || tolerance < 0.0) {
+				std::cout << "Tolerance must be a positive percentage\n";
+				return false;
+			}
+		}
+		else if (arg.compare(0, REPEATSOPTION.size(), REPEATSOPTION) == 0) {
+			repeats = atoi(argv[i] + REPEATSOPTION.size());
+			if (repeats < 1) {
+				std::cout << "Repeats must be a whole number of at least one\n";
+				return false;
+			}
+		}
+		else if (arg.compare(0, MICROOPTION.size(), MICROOPTION) == 0) {
+			if (!parseSwitch(arg.substr(MICROOPTION.size()), "Microbenchmarks", runsMicro)) return false;
+		}
+		else if (arg.compare(0, SCENESOPTION.size(), SCENESOPTION) == 0) {
+			if (!parseSwitch(arg.substr(SCENESOPTION.size()), "Scene benchmarks", runsScenes)) return false;
+		}
+		else if (arg.compare(0, 2, "--") == 0) {
+			std::cout << "Unknown option " << arg << "\n";
+			std::cout << "Argument syntax: [OBJfilename...] [--dir=OBJ/directory/] [--json=results.json] [--baseline=earlier.json] [--tolerance=percent] [--repeats=N] [--micro=on|off] [--scenes=on|off]\n";
+			return false;
+		}
+		else {
+			filenames.push_back(arg);
+		}
+	}
+	return true;
+}
+
+// One thread, and then doubling up to every hardware thread, always including the total
+static std::vector<int> getThreadCounts() {
+	int maxThreadNum = std::max(1, (int)std::thread::hardware_concurrency());
+	std::vector<int> threadCounts;
+	for (int threadNum = 1; threadNum < maxThreadNum; threadNum *= 2) {
+		threadCounts.push_back(threadNum);
+	}
+	threadCounts.push_back(maxThreadNum);
+	return threadCounts;
+}
+
+int main(int argc, char *argv[]) {
+	if (!parseArgs(argc, argv)) return EXIT_FAILURE;
+	SIMDLevels::SIMDLevel supportedLevel = getSupportedSIMDLevel();
+	SceneBenchmarkSettings settings;
+	settings.repeats = repeats;
+	settings.threadCounts = getThreadCounts();
+	std::cout << "CPU supports: " << getSIMDLevelName(supportedLevel) << ", " << settings.threadCounts.back() << " hardware threads\n";
+
+	// The JSON is built in memory, so a file is only written once every benchmark has finished
+	std::ostringstream jsonText;
+	JsonWriter json(jsonText);
+	Metrics metrics;
+	json.beginObject();
+	json.key("machine");
+	json.beginObject();
+	json.field("simd", getSIMDLevelName(supportedLevel));
+	json.field("triangleKernel", getSIMDLevelName(BVH::getSIMDLevel()));
+	json.field("hardwareThreads", settings.threadCounts.back());
+	json.endObject();
+	json.key("settings");
+	json.beginObject();
+	json.field("width", settings.width);
+	json.field("height", settings.height);
+	json.field("fov", (double)settings.fov);
+	json.field("repeats", settings.repeats);
+	// Counting traversal work slows every render down, so timings from such builds can't be compared with others
+	json.field("traversalStats", (bool)TRAVERSAL_STATS);
+	json.endObject();
+
+	bool isSuccess = true;
+	if (runsMicro) {
+		json.key("microbenchmarks");
+		if (!runMicrobenchmarks(repeats, json, metrics)) {
+			std::cout << "Vectorised intersection tests disagree with the scalar ones\n";
+			isSuccess = false;
+		}
+	}
+	if (runsScenes) {
+		if (filenames.empty()) filenames = listOBJFiles(directory);
+		if (filenames.empty()) std::cout << "No OBJ files found in " << directory << "\n";
+		json.key("models");
+		json.beginArray();
+		for (const std::string& filename : filenames) {
+			benchmarkModel(directory, filename, settings, json, metrics);
+		}
+		json.endArray();
+	}
+	json.key("metrics");
+	metrics.write(json);
+	json.endObject();
+
+	if (!jsonPath.empty()) {
+		std::ofstream file(jsonPath);
+		file << jsonText.str();
+		if (!file) {
+			std::cout << "Unable to write results to " << jsonPath << "\n";
+			isSuccess = false;
+		}
+		else std::cout << "Results written to " << jsonPath << "\n";
+	}
+	if (!baselinePath.empty()) {
+		Metrics baseline;
+		if (!baseline.read(baselinePath) || !metrics.compare(baseline, tolerance)) isSuccess = false;
+	}
+	return isSuccess ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,100 @@
+#include <math.h>
+#include <iomanip>
+#include "jsonwriter.h"
+
+// Significant digits numbers are written with, enough for a float to be read back exactly
+static constexpr int NUMBER_PRECISION = 9;
+
+JsonWriter::JsonWriter(std::ostream& _out)
+	: out(_out) {
+}
+
+void JsonWriter::beginItem() {
+	// A value following its key goes on the same line
+	if (isAfterKey) {
+		isAfterKey = false;
+		return;
+	}
+	if (hasItems.empty()) return;
+	if (hasItems.back()) out << ",";
+	hasItems.back() = true;
+	out << "\n" << std::string(hasItems.size(), '\t');
+}
+
+void JsonWriter::writeString(const std::string& text) {
+	out << '"';
+	for (char c : text) {
+		switch (c) {
+		case '"': out << "\\\""; break;
+		case '\\': out << "\\\\"; break;
+		case '\n': out << "\\n"; break;
+		case '\t': out << "\\t"; break;
+		case '\r': out << "\\r"; break;
+		default:
+			// Other control characters are written as their code
+			if ((unsigned char)c < 0x20) out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec << std::setfill(' ');
+			else out << c;
+		}
+	}
+	out << '"';
+}
+
+void JsonWriter::beginObject() {
+	beginItem();
+	out << "{";
+	hasItems.push_back(false);
+}
+
+void JsonWriter::endObject() {
+	bool isEmpty = !hasItems.back();
+	hasItems.pop_back();
+	if (!isEmpty) out << "\n" << std::string(hasItems.size(), '\t');
+	out << "}";
+	if (hasItems.empty()) out << "\n";
+}
+
+void JsonWriter::beginArray() {
+	beginItem();
+	out << "[";
+	hasItems.push_back(false);
+}
+
+void JsonWriter::endArray() {
+	bool isEmpty = !hasItems.back();
+	hasItems.pop_back();
+	if (!isEmpty) out << "\n" << std::string(hasItems.size(), '\t');
+	out << "]";
+	if (hasItems.empty()) out << "\n";
+}
+
+void JsonWriter::key(const std::string& name) {
+	beginItem();
+	writeString(name);
+	out << ": ";
+	isAfterKey = true;
+}
+
+void JsonWriter::value(double number) {
+	beginItem();
+	if (isfinite(number)) out << std::setprecision(NUMBER_PRECISION) << number;
+	else out << "null";
+}
+
+void JsonWriter::value(int number) {
+	beginItem();
+	out << number;
+}
+
+void JsonWriter::value(const std::string& text) {
+	beginItem();
+	writeString(text);
+}
+
+void JsonWriter::value(const char* text) {
+	value(std::string(text));
+}
+
+void JsonWriter::value(bool isTrue) {
+	beginItem();
+	out << (isTrue ? "true" : "false");
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Writes JSON to a stream as it is given, one value per line, with separators and indentation
+// handled for the caller. Values inside an object must each follow a key
+struct JsonWriter {
+private:
+	std::ostream& out;
+	// Whether each object or array still open has had anything written in it yet
+	std::vector<bool> hasItems;
+	bool isAfterKey = false;
+
+	// Start a new value or key, after a separator if it isn't the first in its object or array
+	void beginItem();
+	void writeString(const std::string& text);
+public:
+	JsonWriter(std::ostream& _out);
+
+	void beginObject();
+	void endObject();
+	void beginArray();
+	void endArray();
+	void key(const std::string& name);
+	// Infinite and NaN numbers, which JSON has no way of writing, are written as null
+	void value(double number);
+	void value(int number);
+	void value(const std::string& text);
+	void value(const char* text);
+	void value(bool isTrue);
+
+	// Write a key and its value together
+	template <typename T>
+	void field(const std::string& name, const T& fieldValue) {
+		key(name);
+		value(fieldValue);
+	}
+};
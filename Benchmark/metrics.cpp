@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <math.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include "metrics.h"
+
+// Skip spaces and line breaks in 'text' from 'pos', returning the first other character, or zero at the end
+static char skipSpace(const std::string& text, size_t& pos) {
+	while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) pos++;
+	return pos < text.size() ? text[pos] : '\0';
+}
+
+// Read a JSON string starting at its opening quote, leaving 'pos' after its closing one
+static bool readString(const std::string& text, size_t& pos, std::string& out) {
+	if (skipSpace(text, pos) != '"') return false;
+	out.clear();
+	for (pos++; pos < text.size(); pos++) {
+		char c = text[pos];
+		if (c == '"') {
+			pos++;
+			return true;
+		}
+		// Metric names only ever need quotes and backslashes escaping
+		if (c == '\\' && pos + 1 < text.size()) c = text[++pos];
+		out += c;
+	}
+	return false;
+}
+
+void Metrics::add(const std::string& name, double value) {
+	values[name] = value;
+}
+
+void Metrics::write(JsonWriter& json) const {
+	json.beginObject();
+	for (const auto& metric : values) {
+		json.field(metric.first, metric.second);
+	}
+	json.endObject();
+}
+
+bool Metrics::read(const std::string& path) {
+	std::ifstream file(path);
+	if (!file) {
+		std::cout << "Unable to open baseline " << path << "\n";
+		return false;
+	}
+	std::stringstream contents;
+	contents << file.rdbuf();
+	std::string text = contents.str();
+	// Only the flat object of metrics is read, so the rest of the file's layout can change freely
+	size_t pos = text.find("\"metrics\"");
+	if (pos == std::string::npos) {
+		std::cout << "Baseline " << path << " has no metrics\n";
+		return false;
+	}
+	pos += 9;
+	if (skipSpace(text, pos) != ':') return false;
+	pos++;
+	if (skipSpace(text, pos) != '{') return false;
+	pos++;
+	values.clear();
+	while (skipSpace(text, pos) != '}') {
+		std::string name;
+		if (!readString(text, pos, name) || skipSpace(text, pos) != ':') {
+			std::cout << "Baseline " << path << " has badly formed metrics\n";
+			return false;
+		}
+		pos++;
+		skipSpace(text, pos);
+		// Metrics that couldn't be measured are written as null, and are left out
+		if (text.compare(pos, 4, "null") == 0) pos += 4;
+		else {
+			const char* start = text.c_str() + pos;
+			char* end;
+			double value = strtod(start, &end);
+			if (end == start) {
+				std::cout << "Baseline " << path << " has a badly formed value for " << name << "\n";
+				return false;
+			}
+			values[name] = value;
+			pos += end - start;
+		}
+		if (skipSpace(text, pos) == ',') pos++;
+	}
+	return true;
+}
+
+bool Metrics::compare(const Metrics& baseline, double tolerance) const {
+	int slowerNum = 0;
+	int comparedNum = 0;
+	double logRatioSum = 0.0;
+	std::cout << "\nChange from baseline (negative is faster), tolerance " << tolerance * 100.0 << "%\n";
+	for (const auto& metric : values) {
+		auto base = baseline.values.find(metric.first);
+		if (base == baseline.values.end() || base->second <= 0.0 || metric.second <= 0.0) {
+			std::cout << "  " << metric.first << ": not in baseline\n";
+			continue;
+		}
+		double ratio = metric.second / base->second;
+		bool isSlower = ratio - 1.0 > tolerance;
+		comparedNum++;
+		slowerNum += isSlower;
+		logRatioSum += log(ratio);
+		std::cout << "  " << metric.first << ": " << std::showpos << std::fixed << std::setprecision(1) << (ratio - 1.0) * 100.0 << "%"
+			<< std::noshowpos << std::defaultfloat << std::setprecision(6) << (isSlower ? "  slower\n" : "\n");
+	}
+	if (comparedNum == 0) {
+		std::cout << "No metrics in common with the baseline\n";
+		return false;
+	}
+	// Single timings vary by more than any sensible tolerance from run to run, so the run is judged by
+	// the geometric mean of every change, with each metric slower than the tolerance flagged for a closer look
+	double meanChange = exp(logRatioSum / comparedNum) - 1.0;
+	bool isAccepted = meanChange <= tolerance;
+	std::cout << comparedNum << " metrics compared, " << slowerNum << " slower than the tolerance, mean change "
+		<< std::showpos << std::fixed << std::setprecision(1) << meanChange * 100.0 << "%" << std::noshowpos << std::defaultfloat << std::setprecision(6)
+		<< (isAccepted ? ": accepted\n" : ": REJECTED\n");
+	return isAccepted;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include "jsonwriter.h"
+
+// Measurements a change is judged by, each named by a path such as "m16.obj/front/nsPerRay". Every
+// metric is a cost, such as a time, so lower is always better and any two runs can be compared
+// without knowing what each metric measures
+struct Metrics {
+private:
+	std::map<std::string, double> values;
+public:
+	void add(const std::string& name, double value);
+	// Write the metrics as a JSON object, after the key it belongs to
+	void write(JsonWriter& json) const;
+	// Read the "metrics" object of a JSON file written by an earlier run
+	bool read(const std::string& path);
+	// Print how much each metric has changed from the baseline, returning false if on average they
+	// have got worse by more than 'tolerance', a fraction of their baseline values
+	bool compare(const Metrics& baseline, double tolerance) const;
+};
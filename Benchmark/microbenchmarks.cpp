@@ -0,0 +1,314 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include "microbenchmarks.h"
+#include "timer.h"
+#include "BVH.h"
+#include "vec4.h"
+
+// Triangles per simulated leaf, covering leaves narrower than, equal to, and wider than the kernels
+static const int LEAF_SIZES[] = { 1, 3, 4, 7, 8, 16 };
+static constexpr int LEAF_NUM = 4096;
+static constexpr int RAY_NUM = 1024;
+static constexpr int SINGLE_TRIANGLE_NUM = 4096;
+static constexpr int BOX_NUM = 4096;
+static constexpr float MAX_DIST = 1000000.0;
+
+struct LeafHit {
+	float t;
+	int triangleIndex;
+};
+
+// Random triangles within a unit cube, laid out as leaves of 'leafSize' consecutive triangles
+static TriangleArrays makeTriangles(std::mt19937& random, int leafSize) {
+	std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> edge(-0.5f, 0.5f);
+	TriangleArrays triangles;
+	for (uint32_t i = 0; i < (uint32_t)(LEAF_NUM * leafSize); i++) {
+		Vec3 v0 = Vec3(position(random), position(random), position(random));
+		Vec3 edge0 = Vec3(edge(random), edge(random), edge(random));
+		Vec3 edge1 = Vec3(edge(random), edge(random), edge(random));
+		triangles.push_back(v0, edge0, edge1, i);
+	}
+	triangles.pad();
+	return triangles;
+}
+
+// Rays from a sphere around the cube towards random points inside it, so that most leaves are hit by some rays
+static std::vector<Ray> makeRays(std::mt19937& random) {
+	std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+	std::vector<Ray> rays;
+	for (int i = 0; i < RAY_NUM; i++) {
+		Vec3 origin = Vec3(position(random), position(random), position(random)).normalise() * 3.0f;
+		Vec3 target = Vec3(position(random), position(random), position(random));
+		rays.push_back(Ray(origin, target - origin));
+	}
+	return rays;
+}
+
+// Closest hit in a leaf, taking each kernel's hits in the same order as the BVH does
+static LeafHit intersectLeaf(const TriangleKernel& kernel, const TriangleArrays& triangles, uint32_t first, int leafSize, const Ray& ray) {
+	LeafHit hit = { MAX_DIST, -1 };
+	float dists[MAX_KERNEL_WIDTH];
+	uint32_t end = first + leafSize;
+	for (uint32_t start = first; start < end; start += kernel.width) {
+		int count = std::min(kernel.width, (int)(end - start));
+		int hitMask = kernel.function(triangles, start, count, ray.getOrigin(), ray.getDirection(), dists);
+		for (int i = 0; hitMask != 0; i++, hitMask >>= 1) {
+			if ((hitMask & 1) && dists[i] < hit.t) {
+				hit.t = dists[i];
+				hit.triangleIndex = triangles.triangleIndices[start + i];
+			}
+		}
+	}
+	return hit;
+}
+
+// Test every ray against every leaf, returning the time taken per leaf test in nanoseconds
+static double benchmarkKernel(const TriangleKernel& kernel, const TriangleArrays& triangles, int leafSize, const std::vector<Ray>& rays, int repeats, std::vector<LeafHit>& hits) {
+	double time = getBestTime(repeats, [&]() {
+		hits.clear();
+		hits.reserve(rays.size() * LEAF_NUM);
+		for (int i = 0; i < rays.size(); i++) {
+			for (int leaf = 0; leaf < LEAF_NUM; leaf++) {
+				hits.push_back(intersectLeaf(kernel, triangles, leaf * leafSize, leafSize, rays[i]));
+			}
+		}
+	});
+	return time * 1e9 / ((double)rays.size() * LEAF_NUM);
+}
+
+static bool hitsMatch(const std::vector<LeafHit>& hits, const std::vector<LeafHit>& referenceHits) {
+	for (int i = 0; i < hits.size(); i++) {
+		// Distances are compared exactly, as every kernel should round identically
+		if (hits[i].t != referenceHits[i].t || hits[i].triangleIndex != referenceHits[i].triangleIndex) return false;
+	}
+	return true;
+}
+
+// Compare each kernel against the scalar one, for every leaf size
+static bool benchmarkKernels(std::mt19937& random, const std::vector<Ray>& rays, int repeats, JsonWriter& json, Metrics& metrics) {
+	SIMDLevels::SIMDLevel supportedLevel = getSupportedSIMDLevel();
+	std::cout << "Leaf triangle tests, ns per ray per leaf (speedup over scalar)\n";
+	bool isMatch = true;
+	json.beginArray();
+	for (int leafSize : LEAF_SIZES) {
+		TriangleArrays triangles = makeTriangles(random, leafSize);
+		std::vector<LeafHit> referenceHits, hits;
+		double scalarTime = benchmarkKernel(getTriangleKernel(SIMDLevels::scalar), triangles, leafSize, rays, repeats, referenceHits);
+		std::cout << "Leaf size " << std::setw(2) << leafSize << ":  scalar " << scalarTime;
+		json.beginObject();
+		json.field("leafSize", leafSize);
+		json.key("nsPerLeaf");
+		json.beginObject();
+		json.field(getSIMDLevelName(SIMDLevels::scalar), scalarTime);
+		metrics.add("micro/kernel/scalar/leaf" + std::to_string(leafSize) + "/nsPerLeaf", scalarTime);
+		bool isLeafMatch = true;
+		for (int level = SIMDLevels::sse; level <= supportedLevel; level++) {
+			TriangleKernel kernel = getTriangleKernel((SIMDLevels::SIMDLevel)level);
+			double time = benchmarkKernel(kernel, triangles, leafSize, rays, repeats, hits);
+			bool isKernelMatch = hitsMatch(hits, referenceHits);
+			isLeafMatch &= isKernelMatch;
+			std::cout << "  " << getSIMDLevelName(kernel.level) << " " << time << " (" << scalarTime / time << "x)";
+			if (!isKernelMatch) std::cout << " MISMATCH";
+			json.field(getSIMDLevelName(kernel.level), time);
+			metrics.add(std::string("micro/kernel/") + getSIMDLevelName(kernel.level) + "/leaf" + std::to_string(leafSize) + "/nsPerLeaf", time);
+		}
+		std::cout << "\n";
+		json.endObject();
+		json.field("matchesScalar", isLeafMatch);
+		json.endObject();
+		isMatch &= isLeafMatch;
+	}
+	json.endArray();
+	return isMatch;
+}
+
+// ------------------------------------------------- //
+//               Single triangle tests               //
+// ------------------------------------------------- //
+
+// A triangle's first vertex and the edges from it, as the intersection tests take them
+struct SingleTriangle {
+	Vec3 v0, edge0, edge1;
+};
+
+struct SingleTriangle4 {
+	Vec4 v0, edge0, edge1;
+};
+
+// One ray against one triangle, written with Vec3's operators in the same order as the scalar kernel,
+// so its speed depends on every one of them being inlined
+static bool rayTriangleIntersection(const SingleTriangle& triangle, const Vec3& rayOrigin, const Vec3& rayDirection, float& t) {
+	Vec3 pvec = rayDirection.cross(triangle.edge1);
+	float det = triangle.edge0.dot(pvec);
+	if (det <= MIN_DETERMINANT) return false;
+	float invDet = 1 / det;
+
+	Vec3 tvec = rayOrigin - triangle.v0;
+	float u = tvec.dot(pvec) * invDet;
+	if (u < 0.0f || u > 1.0f) return false;
+	Vec3 qvec = tvec.cross(triangle.edge0);
+	float v = rayDirection.dot(qvec) * invDet;
+	if (v < 0.0f || u + v > 1.0f) return false;
+	t = triangle.edge1.dot(qvec) * invDet;
+	return t > 0.0f;
+}
+
+// The same test with the vectors held in SIMD registers
+static bool rayTriangleIntersection(const SingleTriangle4& triangle, const Vec4& rayOrigin, const Vec4& rayDirection, float& t) {
+	Vec4 pvec = rayDirection.cross3(triangle.edge1);
+	float det = triangle.edge0.dot3(pvec);
+	if (det <= MIN_DETERMINANT) return false;
+	float invDet = 1 / det;
+
+	Vec4 tvec = rayOrigin - triangle.v0;
+	float u = tvec.dot3(pvec) * invDet;
+	if (u < 0.0f || u > 1.0f) return false;
+	Vec4 qvec = tvec.cross3(triangle.edge0);
+	float v = rayDirection.dot3(qvec) * invDet;
+	if (v < 0.0f || u + v > 1.0f) return false;
+	t = triangle.edge1.dot3(qvec) * invDet;
+	return t > 0.0f;
+}
+
+// Test every ray against every triangle, returning the time taken per test in nanoseconds. 'hitSum'
+// adds up the distances to every hit, both so that the tests can't be optimised away and to compare them
+template <typename Triangle, typename Vector>
+static double benchmarkSingleTriangles(const std::vector<Triangle>& triangles, const std::vector<Ray>& rays, int repeats, double& hitSum) {
+	double time = getBestTime(repeats, [&]() {
+		hitSum = 0.0;
+		for (const Ray& ray : rays) {
+			const Vector origin = Vector(ray.getOrigin());
+			const Vector direction = Vector(ray.getDirection());
+			for (const Triangle& triangle : triangles) {
+				float t;
+				if (rayTriangleIntersection(triangle, origin, direction, t)) hitSum += t;
+			}
+		}
+	});
+	return time * 1e9 / ((double)rays.size() * triangles.size());
+}
+
+// Compare single ray-triangle tests through the inline Vec3 and Vec4 math
+static bool benchmarkSingleTriangles(std::mt19937& random, const std::vector<Ray>& rays, int repeats, JsonWriter& json, Metrics& metrics) {
+	std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> edge(-0.5f, 0.5f);
+	std::vector<SingleTriangle> triangles;
+	std::vector<SingleTriangle4> triangles4;
+	for (int i = 0; i < SINGLE_TRIANGLE_NUM; i++) {
+		SingleTriangle triangle = {
+			Vec3(position(random), position(random), position(random)),
+			Vec3(edge(random), edge(random), edge(random)),
+			Vec3(edge(random), edge(random), edge(random)) };
+		triangles.push_back(triangle);
+		triangles4.push_back({ Vec4(triangle.v0), Vec4(triangle.edge0), Vec4(triangle.edge1) });
+	}
+	double vec3Sum = 0.0, vec4Sum = 0.0;
+	double vec3Time = benchmarkSingleTriangles<SingleTriangle, Vec3>(triangles, rays, repeats, vec3Sum);
+	double vec4Time = benchmarkSingleTriangles<SingleTriangle4, Vec4>(triangles4, rays, repeats, vec4Sum);
+	std::cout << "Single triangle tests, ns per ray per triangle:  Vec3 " << vec3Time
+		<< "  Vec4 " << vec4Time << " (" << vec3Time / vec4Time << "x)";
+	// Both round identically, so they should hit the same triangles at the same distances
+	bool isMatch = vec3Sum == vec4Sum;
+	if (!isMatch) std::cout << " MISMATCH";
+	std::cout << "\n";
+	json.beginObject();
+	json.field("vec3NsPerTest", vec3Time);
+	json.field("vec4NsPerTest", vec4Time);
+	json.field("matches", isMatch);
+	json.endObject();
+	metrics.add("micro/singleTriangle/vec3/nsPerTest", vec3Time);
+	metrics.add("micro/singleTriangle/vec4/nsPerTest", vec4Time);
+	return isMatch;
+}
+
+// ------------------------------------- //
+//               Box tests               //
+// ------------------------------------- //
+
+struct Box4 {
+	Vec4 min, max;
+};
+
+// Slab test with the same operations as AABB::rayIntersection, three axes at a time
+static bool rayBoxIntersection(const Box4& box, const Vec4& origin, const Vec4& invDirection, float t, float& tEntry) {
+	const Vec4 t0 = (box.min - origin) * invDirection;
+	const Vec4 t1 = (box.max - origin) * invDirection;
+	const Vec4 entries = t0.min(t1);
+	const Vec4 exits = t0.max(t1);
+	const float tNear = std::max(std::max(entries.getX(), entries.getY()), entries.getZ());
+	const float tFar = std::min(std::min(exits.getX(), exits.getY()), exits.getZ());
+	tEntry = tNear;
+	return tNear <= tFar && tFar >= 0.0f && tNear < t;
+}
+
+static bool rayBoxIntersection(const AABB& box, const Vec3& origin, const Vec3& invDirection, float t, float& tEntry) {
+	return box.rayIntersection(origin, invDirection, t, tEntry);
+}
+
+// Test every ray against every box, returning the time taken per test in nanoseconds, and adding up
+// where each box hit is entered in 'entrySum'
+template <typename Box, typename Vector>
+static double benchmarkBoxes(const std::vector<Box>& boxes, const std::vector<Ray>& rays, int repeats, double& entrySum) {
+	double time = getBestTime(repeats, [&]() {
+		entrySum = 0.0;
+		for (const Ray& ray : rays) {
+			const Vector origin = Vector(ray.getOrigin());
+			const Vector invDirection = Vector(ray.getInvDirection());
+			for (const Box& box : boxes) {
+				float tEntry;
+				if (rayBoxIntersection(box, origin, invDirection, MAX_DIST, tEntry)) entrySum += tEntry;
+			}
+		}
+	});
+	return time * 1e9 / ((double)rays.size() * boxes.size());
+}
+
+// Compare ray-box slab tests through AABB and through Vec4
+static bool benchmarkBoxes(std::mt19937& random, const std::vector<Ray>& rays, int repeats, JsonWriter& json, Metrics& metrics) {
+	std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> size(0.0f, 0.5f);
+	std::vector<AABB> boxes;
+	std::vector<Box4> boxes4;
+	for (int i = 0; i < BOX_NUM; i++) {
+		Vec3 min = Vec3(position(random), position(random), position(random));
+		AABB box = AABB(min, min + Vec3(size(random), size(random), size(random)));
+		boxes.push_back(box);
+		boxes4.push_back({ Vec4(box.min), Vec4(box.max) });
+	}
+	double aabbSum = 0.0, vec4Sum = 0.0;
+	double aabbTime = benchmarkBoxes<AABB, Vec3>(boxes, rays, repeats, aabbSum);
+	double vec4Time = benchmarkBoxes<Box4, Vec4>(boxes4, rays, repeats, vec4Sum);
+	std::cout << "Box tests, ns per ray per box:  AABB " << aabbTime
+		<< "  Vec4 " << vec4Time << " (" << aabbTime / vec4Time << "x)";
+	bool isMatch = aabbSum == vec4Sum;
+	if (!isMatch) std::cout << " MISMATCH";
+	std::cout << "\n";
+	json.beginObject();
+	json.field("aabbNsPerTest", aabbTime);
+	json.field("vec4NsPerTest", vec4Time);
+	json.field("matches", isMatch);
+	json.endObject();
+	metrics.add("micro/box/aabb/nsPerTest", aabbTime);
+	metrics.add("micro/box/vec4/nsPerTest", vec4Time);
+	return isMatch;
+}
+
+bool runMicrobenchmarks(int repeats, JsonWriter& json, Metrics& metrics) {
+	std::mt19937 random(1);
+	std::vector<Ray> rays = makeRays(random);
+	bool isMatch = true;
+	std::cout << std::fixed << std::setprecision(2);
+	json.beginObject();
+	json.key("triangleKernels");
+	isMatch &= benchmarkKernels(random, rays, repeats, json, metrics);
+	json.key("singleTriangle");
+	isMatch &= benchmarkSingleTriangles(random, rays, repeats, json, metrics);
+	json.key("boxes");
+	isMatch &= benchmarkBoxes(random, rays, repeats, json, metrics);
+	json.endObject();
+	std::cout << std::defaultfloat << std::setprecision(6);
+	return isMatch;
+}
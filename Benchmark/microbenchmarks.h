@@ -0,0 +1,10 @@
+#pragma once
+
+#include "jsonwriter.h"
+#include "metrics.h"
+
+// Time the ray-triangle and ray-box tests on random triangles and boxes, each test on its own rather
+// than in a hierarchy, so that changes to them can be measured without anything else in the way.
+// Writes the results as a JSON object after the key it belongs to, and returns false if any
+// vectorised test disagrees with the scalar one it should match exactly
+bool runMicrobenchmarks(int repeats, JsonWriter& json, Metrics& metrics);
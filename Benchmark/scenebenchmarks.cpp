@@ -0,0 +1,181 @@
+#include <math.h>
+#include <iostream>
+#include <algorithm>
+#include "scenebenchmarks.h"
+#include "timer.h"
+#include "camera.h"
+#include "modelloader.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+static constexpr float PI = 3.14159265f;
+static constexpr float DEG2RAD = PI / 180;
+// OBJ files have +y up, whereas the screen has -y up, so every model is flipped in y, as the renderer does
+static const Transform MODEL_TRANSFORM = Transform(0.0f, 0.0f, 0.0f, false, true, false);
+// Space left around a model in each view, as a fraction of the distance that would just fit it in the frame
+static constexpr float VIEW_MARGIN = 1.1f;
+
+// Camera set up relative to a model's bounds, so that every model fills the frame the same way
+struct BenchmarkView {
+	const char* name;
+	// Directions the camera looks along, and of the right of the screen, which the yaw and pitch turn it to
+	Vec3 forward;
+	Vec3 right;
+	float yaw;
+	float pitch;
+};
+
+// Looking along +z at the front, along +x at the side, and down at 45 degrees from above the front,
+// where -y is up. Positive yaw turns towards +x, and positive pitch looks up
+static const BenchmarkView VIEWS[] = {
+	{ "front", Vec3(0.0f, 0.0f, 1.0f), Vec3(1.0f, 0.0f, 0.0f), 0.0f, 0.0f },
+	{ "side", Vec3(1.0f, 0.0f, 0.0f), Vec3(0.0f, 0.0f, -1.0f), 90.0f, 0.0f },
+	{ "above", Vec3(0.0f, 0.70710678f, 0.70710678f), Vec3(1.0f, 0.0f, 0.0f), 0.0f, -45.0f }
+};
+
+// Distance back from the centre of 'bounds' the camera needs to be for every corner of them to be in frame
+static float getViewDistance(const BenchmarkView& view, const AABB& bounds, const SceneBenchmarkSettings& settings) {
+	float tanHalfFOV = tan(settings.fov * 0.5f * DEG2RAD);
+	float tanHalfVerticalFOV = tanHalfFOV * settings.height / (float)settings.width;
+	Vec3 up = view.forward.cross(view.right);
+	Vec3 halfExtent = bounds.getExtent() * 0.5f;
+	float distance = 0.0f;
+	for (int corner = 0; corner < 8; corner++) {
+		Vec3 offset = Vec3(
+			corner & 1 ? halfExtent.x : -halfExtent.x,
+			corner & 2 ? halfExtent.y : -halfExtent.y,
+			corner & 4 ? halfExtent.z : -halfExtent.z);
+		// The corner is in frame if it is within the field of view either side at its depth from the camera
+		float depth = offset.dot(view.forward);
+		distance = std::max(distance, fabs(offset.dot(view.right)) / tanHalfFOV - depth);
+		distance = std::max(distance, fabs(offset.dot(up)) / tanHalfVerticalFOV - depth);
+	}
+	return std::max(distance, 1e-3f) * VIEW_MARGIN;
+}
+
+std::vector<std::string> listOBJFiles(const std::string& directory) {
+	std::vector<std::string> filenames;
+	auto isOBJ = [](const std::string& filename) {
+		if (filename.size() < 4) return false;
+		std::string extension = filename.substr(filename.size() - 4);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		return extension == ".obj";
+	};
+#ifdef _WIN32
+	WIN32_FIND_DATAA findData;
+	HANDLE find = FindFirstFileA((directory + "*").c_str(), &findData);
+	if (find != INVALID_HANDLE_VALUE) {
+		do {
+			if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && isOBJ(findData.cFileName)) filenames.push_back(findData.cFileName);
+		} while (FindNextFileA(find, &findData));
+		FindClose(find);
+	}
+#else
+	DIR* dir = opendir(directory.c_str());
+	if (dir != nullptr) {
+		while (dirent* entry = readdir(dir)) {
+			if (isOBJ(entry->d_name)) filenames.push_back(entry->d_name);
+		}
+		closedir(dir);
+	}
+#endif
+	std::sort(filenames.begin(), filenames.end());
+	return filenames;
+}
+
+// Render the camera's view, keeping the fastest of the repeats, and return the primary rays traced per second
+static double benchmarkRender(Camera& cam, const SceneBenchmarkSettings& settings) {
+	Framebuffer framebuffer(settings.width, settings.height);
+	double time = getBestTime(settings.repeats, [&]() {
+		cam.renderImage(framebuffer);
+	});
+	return (double)settings.width * settings.height / time;
+}
+
+bool benchmarkModel(const std::string& directory, const std::string& filename, const SceneBenchmarkSettings& settings, JsonWriter& json, Metrics& metrics) {
+	std::string path = directory + filename;
+	std::shared_ptr<ThreadPool> pool = std::make_shared<ThreadPool>();
+	// The file is parsed on its own first, as the model's constructor only times building its hierarchy
+	bool isLoaded = true;
+	double parseTime = getBestTime(settings.repeats, [&]() {
+		std::vector<Vec3> vertices, normals;
+		std::vector<uint32_t> vertexIndices, normalIndices;
+		isLoaded &= loadOBJ(path.c_str(), vertices, normals, vertexIndices, normalIndices, MODEL_TRANSFORM, pool.get()) && !vertexIndices.empty();
+	});
+	if (!isLoaded) {
+		std::cout << filename << ": could not be loaded, skipped\n";
+		return false;
+	}
+	std::shared_ptr<Model> model = std::make_shared<Model>(path, Vec3(), MODEL_TRANSFORM, BuildStrategies::sah, 2, pool.get());
+	double buildTime = model->getBVHBuildTime();
+	std::cout << filename << ": " << model->getTriangleNum() << " triangles, " << model->getBVHNodeNum() << " BVH nodes, parsed in "
+		<< parseTime << "s, built in " << buildTime << "s\n";
+	json.beginObject();
+	json.field("file", filename);
+	json.field("triangles", model->getTriangleNum());
+	json.field("vertices", model->getVertexNum());
+	json.field("bvhNodes", model->getBVHNodeNum());
+	json.field("sahCost", (double)model->getBVHCost());
+	json.field("parseSeconds", parseTime);
+	json.field("buildSeconds", buildTime);
+	metrics.add(filename + "/parseSeconds", parseTime);
+	metrics.add(filename + "/buildSeconds", buildTime);
+
+	AABB bounds = model->getBounds();
+	Camera cam(Vec3(), settings.width, settings.height, settings.fov);
+	cam.insertModel(model);
+	cam.setThreadPool(pool);
+	cam.setPrintsProgress(false);
+	json.key("views");
+	json.beginArray();
+	for (const BenchmarkView& view : VIEWS) {
+		cam.setPosition(bounds.getCenter() - view.forward * getViewDistance(view, bounds, settings));
+		cam.setRotation(view.yaw, view.pitch);
+		double raysPerSecond = benchmarkRender(cam, settings);
+		std::cout << "  " << view.name << ": " << raysPerSecond / 1e6 << " million primary rays per second\n";
+		json.beginObject();
+		json.field("name", view.name);
+		json.field("raysPerSecond", raysPerSecond);
+#if TRAVERSAL_STATS
+		// Work done per pixel in the last of the repeats, which all trace the same rays
+		const TraversalStats& stats = cam.getTraversalStats();
+		json.field("meanBoxTests", stats.getMean(TraversalCounters::boxTests));
+		json.field("meanNodesVisited", stats.getMean(TraversalCounters::nodesVisited));
+		json.field("meanTriangleTests", stats.getMean(TraversalCounters::triangleTests));
+#endif
+		json.endObject();
+		metrics.add(filename + "/" + view.name + "/nsPerRay", 1e9 / raysPerSecond);
+	}
+	json.endArray();
+
+	// Scaling is measured on the first view, against the first thread count, which is one
+	cam.setPosition(bounds.getCenter() - VIEWS[0].forward * getViewDistance(VIEWS[0], bounds, settings));
+	cam.setRotation(VIEWS[0].yaw, VIEWS[0].pitch);
+	json.key("threadScaling");
+	json.beginArray();
+	std::cout << "  speedup with threads:";
+	double singleRate = 0.0;
+	for (int threadNum : settings.threadCounts) {
+		cam.setThreadPool(std::make_shared<ThreadPool>(threadNum));
+		double raysPerSecond = benchmarkRender(cam, settings);
+		if (singleRate == 0.0) singleRate = raysPerSecond;
+		double speedup = raysPerSecond / singleRate;
+		std::cout << " " << threadNum << " (" << speedup << "x)";
+		json.beginObject();
+		json.field("threads", threadNum);
+		json.field("raysPerSecond", raysPerSecond);
+		json.field("speedup", speedup);
+		json.field("efficiency", speedup / threadNum);
+		json.endObject();
+		metrics.add(filename + "/threads" + std::to_string(threadNum) + "/nsPerRay", 1e9 / raysPerSecond);
+	}
+	std::cout << "\n";
+	json.endArray();
+	json.endObject();
+	return true;
+}
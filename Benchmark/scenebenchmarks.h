@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "jsonwriter.h"
+#include "metrics.h"
+
+struct SceneBenchmarkSettings {
+	int width = 640;
+	int height = 480;
+	float fov = 60.0f;
+	// Times each render is repeated, keeping the fastest
+	int repeats = 3;
+	// Thread counts the first view is rendered with to measure scaling, starting from one
+	std::vector<int> threadCounts;
+};
+
+// Names of the OBJ files in a directory, in alphabetical order
+std::vector<std::string> listOBJFiles(const std::string& directory);
+
+// Load an OBJ file, timing how long it takes to parse and to build its hierarchy, and then render it
+// from fixed views framed around its bounds, and with each number of threads. Writes the results as
+// a JSON object, and returns false if the file couldn't be loaded
+bool benchmarkModel(const std::string& directory, const std::string& filename, const SceneBenchmarkSettings& settings, JsonWriter& json, Metrics& metrics);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <chrono>
+
+// Shortest time in seconds that 'function' takes over 'repeats' runs. The fastest run is the one
+// least disturbed by anything else on the machine, so is the most repeatable between runs
+template <typename Function>
+double getBestTime(int repeats, const Function& function) {
+	double bestTime = 0.0;
+	for (int i = 0; i < repeats; i++) {
+		auto start = std::chrono::steady_clock::now();
+		function();
+		double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (i == 0 || time < bestTime) bestTime = time;
+	}
+	return bestTime;
+}
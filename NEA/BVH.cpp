@@ -1,151 +1,653 @@
 
+#include <algorithm>
+#include <chrono>
 #include "BVH.h"
+#include "threadpool.h"
+#include "modelcache.h"
+#include "trianglefile.h"
+#include "traversalstats.h"
 
-static constexpr float MAX_DIST = 1000000.0;
+// Rough memory the in-memory builder needs per triangle: the triangle, its bounds, center and two
+// entries in the triangle order, and as many as two nodes
+static constexpr size_t BUILD_BYTES_PER_TRIANGLE =
+	sizeof(Triangle) + sizeof(AABB) + sizeof(Vec3) + 2 * sizeof(uint32_t) + 2 * sizeof(LinearBVHNode);
+// Triangles read from a file at once while splitting it
+static constexpr size_t STREAM_BATCH_SIZE = 1 << 16;
+// Bins triangle centers are counted into, to find where to split a file in half
+static constexpr int STREAM_BIN_NUM = 256;
+// A ray packet is split into single rays once fewer than this fraction of its rays are still active
+static constexpr int PACKET_SPLIT_RATIO = 8;
 
-void BVHNode::updateBoundRadius(Vec3 vertex) {
-	const float tempRadius = (vertex - center).getLength();
-	if (radius < tempRadius) {
-		radius = tempRadius;
-	}
+Axes::Axes getAxis(Vec3 sumOfSqrs) {
+	// Get the axis with the greatest variance
+	if (sumOfSqrs.x > sumOfSqrs.y && sumOfSqrs.x > sumOfSqrs.z) return Axes::x;
+	else if (sumOfSqrs.y > sumOfSqrs.z)                         return Axes::y;
+	else                                                        return Axes::z;
 }
 
-void BVHNode::calcBounds(Model* model) {
-	// Calculate the average center of all the triangles in the set
-	for (int i = 0; i < triangles.size(); i++) {
-		center = center + triangles[i].getCenter();
+float getAxisComponent(const Vec3& vector, int axis) {
+	if (axis == Axes::x) return vector.x;
+	else if (axis == Axes::y) return vector.y;
+	else return vector.z;
+}
+
+AABB getTriangleBounds(const Model* model, const Triangle& triangle) {
+	AABB bounds;
+	bounds.grow(model->getVertex(triangle.getv0Index()));
+	bounds.grow(model->getVertex(triangle.getv1Index()));
+	bounds.grow(model->getVertex(triangle.getv2Index()));
+	return bounds;
+}
+
+Vec3 getTriangleCenter(const Model* model, const Triangle& triangle) {
+	return (
+		model->getVertex(triangle.getv0Index()) +
+		model->getVertex(triangle.getv1Index()) +
+		model->getVertex(triangle.getv2Index())) / 3.0f;
+}
+
+BVHBuilder::BVHBuilder(
+	const std::vector<Triangle>& triangles,
+	const Model* model,
+	BuildStrategies::BuildStrategy _strategy,
+	ThreadPool* _threadPool)
+	: triangleBounds(triangles.size()),
+	triangleCenters(triangles.size()),
+	triangleOrder(triangles.size()),
+	partitionBuffer(triangles.size()),
+	strategy(_strategy),
+	threadPool(_threadPool) {
+	// Triangle bounds and centers are needed throughout building, so are calculated once up front
+	auto calcTriangles = [&](uint32_t start, uint32_t end) {
+		for (uint32_t i = start; i < end; i++) {
+			triangleBounds[i] = getTriangleBounds(model, triangles[i]);
+			triangleCenters[i] = getTriangleCenter(model, triangles[i]);
+			triangleOrder[i] = i;
+		}
+	};
+	uint32_t triangleNum = triangles.size();
+	if (threadPool != nullptr && threadPool->getThreadNum() > 1 && triangleNum >= minParallelTriangleNum) {
+		int chunkNum = threadPool->getThreadNum();
+		threadPool->parallelFor(chunkNum, [&](int chunk) {
+			calcTriangles(
+				(uint32_t)((uint64_t)triangleNum * chunk / chunkNum),
+				(uint32_t)((uint64_t)triangleNum * (chunk + 1) / chunkNum));
+		});
 	}
-	center = center / triangles.size();
-	// Update the bounds, testing each vertex of every triangle in the set
-	for (int i = 0; i < triangles.size(); i++) {
-		updateBoundRadius(
-			model->getVertex(
-				triangles[i].getv0Index()));
-		updateBoundRadius(
-			model->getVertex(
-				triangles[i].getv1Index()));
-		updateBoundRadius(
-			model->getVertex(
-				triangles[i].getv2Index()));
+	else {
+		calcTriangles(0, triangleNum);
 	}
 }
 
-Axes::Axes getAxis(Vec3 sumOfSqrs) {
-	// Get the axis with the greatest variance
-	if (sumOfSqrs.x > sumOfSqrs.y && sumOfSqrs.x > sumOfSqrs.z) return Axes::x;
-	else if (sumOfSqrs.y > sumOfSqrs.z)                         return Axes::y;
-	else                                                        return Axes::z;
+void BVHBuilder::build(std::vector<LinearBVHNode>& nodes, int rootDepth) {
+	nodes.clear();
+	if (triangleOrder.empty()) return;
+	buildNode(0, triangleOrder.size(), rootDepth, nodes);
+}
+
+const std::vector<uint32_t>& BVHBuilder::getTriangleOrder() const {
+	return triangleOrder;
 }
 
-Axes::Axes BVHNode::calcAxisWithGreatestVariance() {
+Axes::Axes BVHBuilder::calcAxisWithGreatestVariance(uint32_t start, uint32_t end) const {
 	Vec3 mean, sumOfSqrs;
-	for (int i = 0; i < triangles.size(); i++) {
-		Vec3 center = triangles[i].getCenter();
+	for (uint32_t i = start; i < end; i++) {
+		Vec3 center = triangleCenters[triangleOrder[i]];
 		Vec3 oldMean = mean;
-		mean = mean + (center - mean) / (float)(i + 1);
+		mean = mean + (center - mean) / (float)(i - start + 1);
 		sumOfSqrs = sumOfSqrs + (center - mean) * (center - oldMean);
 	}
 	return getAxis(sumOfSqrs);
 }
 
-void BVHNode::partitionX(std::vector<Triangle>& leftPartitionTriangles, std::vector<Triangle>& rightPartitionTriangles) {
-	for (int i = 0; i < triangles.size(); i++) {
-		if (triangles[i].getCenter().x < center.x) {
-			leftPartitionTriangles.push_back(triangles[i]);
+template <typename Predicate>
+uint32_t BVHBuilder::partition(uint32_t start, uint32_t end, Predicate isLeft) {
+	// Left triangles are compacted in place while right ones are set aside in the buffer, so
+	// both sides keep their order. Concurrent builds only ever touch their own ranges of either array
+	uint32_t leftEnd = start;
+	uint32_t rightEnd = start;
+	for (uint32_t i = start; i < end; i++) {
+		uint32_t triangle = triangleOrder[i];
+		if (isLeft(triangle)) {
+			triangleOrder[leftEnd++] = triangle;
 		}
 		else {
-			rightPartitionTriangles.push_back(triangles[i]);
+			partitionBuffer[rightEnd++] = triangle;
 		}
 	}
+	std::copy(partitionBuffer.begin() + start, partitionBuffer.begin() + rightEnd, triangleOrder.begin() + leftEnd);
+	return leftEnd;
 }
 
-void BVHNode::partitionY(std::vector<Triangle>& leftPartitionTriangles, std::vector<Triangle>& rightPartitionTriangles) {
-	for (int i = 0; i < triangles.size(); i++) {
-		if (triangles[i].getCenter().y < center.y) {
-			leftPartitionTriangles.push_back(triangles[i]);
+uint32_t BVHBuilder::splitMean(uint32_t start, uint32_t end) {
+	if (end - start <= minTriangleNumPerLeaf) return start;
+	// Split at the mean of the triangle centers, along the axis they vary most on
+	Vec3 center;
+	for (uint32_t i = start; i < end; i++) {
+		center = center + triangleCenters[triangleOrder[i]];
+	}
+	center = center / (float)(end - start);
+	Axes::Axes axis = calcAxisWithGreatestVariance(start, end);
+	float splitPosition = getAxisComponent(center, axis);
+	uint32_t middle = partition(start, end, [&](uint32_t triangle) {
+		return getAxisComponent(triangleCenters[triangle], axis) < splitPosition;
+	});
+	// If every triangle center lies on the same side (e.g. duplicated triangles),
+	// splitting would recurse forever, so keep the node as a leaf
+	if (middle == end) return start;
+	return middle;
+}
+
+uint32_t BVHBuilder::splitSAH(uint32_t start, uint32_t end, const AABB& bounds) {
+	// Bound the triangle centers, which the bins are spaced over
+	AABB centerBounds;
+	for (uint32_t i = start; i < end; i++) {
+		centerBounds.grow(triangleCenters[triangleOrder[i]]);
+	}
+	// Splitting has to be cheaper than intersecting every triangle in the node
+	float parentArea = bounds.getSurfaceArea();
+	float bestCost = sahIntersectionCost * (end - start);
+	int bestAxis = -1;
+	int bestBin = -1;
+	for (int axis = 0; axis < 3; axis++) {
+		float binStart = getAxisComponent(centerBounds.min, axis);
+		float extent = getAxisComponent(centerBounds.max, axis) - binStart;
+		if (extent <= 0.0f) continue;
+		float binScale = sahBinNum / extent;
+		// Sort the triangles into equally sized bins by their centers
+		AABB binBounds[sahBinNum];
+		int binCounts[sahBinNum] = {};
+		for (uint32_t i = start; i < end; i++) {
+			uint32_t triangle = triangleOrder[i];
+			int bin = std::min(sahBinNum - 1, (int)((getAxisComponent(triangleCenters[triangle], axis) - binStart) * binScale));
+			binBounds[bin].grow(triangleBounds[triangle]);
+			binCounts[bin]++;
 		}
-		else {
-			rightPartitionTriangles.push_back(triangles[i]);
+		// Sweep from the right to find the area and count on the right of each plane between bins
+		float rightAreas[sahBinNum - 1];
+		int rightCounts[sahBinNum - 1];
+		AABB sweepBounds;
+		int sweepCount = 0;
+		for (int i = sahBinNum - 1; i > 0; i--) {
+			sweepBounds.grow(binBounds[i]);
+			sweepCount += binCounts[i];
+			rightAreas[i - 1] = sweepBounds.getSurfaceArea();
+			rightCounts[i - 1] = sweepCount;
 		}
+		// Sweep from the left, costing each plane
+		sweepBounds = AABB();
+		sweepCount = 0;
+		for (int i = 0; i < sahBinNum - 1; i++) {
+			sweepBounds.grow(binBounds[i]);
+			sweepCount += binCounts[i];
+			if (sweepCount == 0 || rightCounts[i] == 0) continue;
+			float cost = sahTraversalCost + sahIntersectionCost *
+				(sweepBounds.getSurfaceArea() * sweepCount + rightAreas[i] * rightCounts[i]) / parentArea;
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = i;
+			}
+		}
+	}
+	// No plane beats the cost of a leaf, so stop splitting
+	if (bestAxis == -1) return start;
+
+	float binStart = getAxisComponent(centerBounds.min, bestAxis);
+	float binScale = sahBinNum / (getAxisComponent(centerBounds.max, bestAxis) - binStart);
+	return partition(start, end, [&](uint32_t triangle) {
+		return std::min(sahBinNum - 1, (int)((getAxisComponent(triangleCenters[triangle], bestAxis) - binStart) * binScale)) <= bestBin;
+	});
+}
+
+// Append a subtree built into its own array, moving its interior nodes' child indices along with it,
+// and its leaves' triangle ranges along by 'firstTriangle'
+static void appendNodes(std::vector<LinearBVHNode>& nodes, const std::vector<LinearBVHNode>& subtreeNodes, uint32_t firstTriangle = 0) {
+	uint32_t baseIndex = nodes.size();
+	for (const LinearBVHNode& node : subtreeNodes) {
+		nodes.push_back(node);
+		nodes.back().offset += node.triangleNum == 0 ? baseIndex : firstTriangle;
+	}
+}
+
+uint32_t BVHBuilder::buildNode(uint32_t start, uint32_t end, int depth, std::vector<LinearBVHNode>& nodes) {
+	AABB bounds;
+	for (uint32_t i = start; i < end; i++) {
+		bounds.grow(triangleBounds[triangleOrder[i]]);
+	}
+	// Leaves refer to their range of the triangle order, which becomes the leaf order of the triangle arrays
+	uint32_t nodeIndex = nodes.size();
+	nodes.push_back(LinearBVHNode{ bounds, start, end - start });
+	if (depth + 1 >= maxDepth) return nodeIndex;
+	// The surface area heuristic decides when a node is cheaper left as a leaf
+	uint32_t middle = strategy == BuildStrategies::sah ? splitSAH(start, end, bounds) : splitMean(start, end);
+	if (middle == start) return nodeIndex;
+
+	nodes[nodeIndex].triangleNum = 0;
+	if (threadPool != nullptr && threadPool->getThreadNum() > 1 && end - start >= minParallelTriangleNum) {
+		// Build the first child as a task while this thread builds the second, each into its own
+		// array, then join them. The first child is still placed directly after this node
+		std::vector<LinearBVHNode> child0Nodes, child1Nodes;
+		TaskGroup group;
+		threadPool->submit(group, [&]() { buildNode(start, middle, depth + 1, child0Nodes); });
+		buildNode(middle, end, depth + 1, child1Nodes);
+		threadPool->wait(group);
+		appendNodes(nodes, child0Nodes);
+		nodes[nodeIndex].offset = nodes.size();
+		appendNodes(nodes, child1Nodes);
+	}
+	else {
+		// The first child is placed directly after this node, so only the second child's index is stored
+		buildNode(start, middle, depth + 1, nodes);
+		uint32_t child1Index = buildNode(middle, end, depth + 1, nodes);
+		nodes[nodeIndex].offset = child1Index;
 	}
+	return nodeIndex;
 }
 
-void BVHNode::partitionZ(std::vector<Triangle>& leftPartitionTriangles, std::vector<Triangle>& rightPartitionTriangles) {
-	for (int i = 0; i < triangles.size(); i++) {
-		if (triangles[i].getCenter().z < center.z) {
-			leftPartitionTriangles.push_back(triangles[i]);
+// ------------------------------- //
+//               BVH               //
+// ------------------------------- //
+
+TriangleKernel BVH::triangleKernel = getTriangleKernel(getSupportedSIMDLevel());
+
+BVH::BVH()
+	: width(2), buildTime(0.0f), builtCost(-1.0f) {
+}
+
+// ------------------------------------------ //
+//               Triangle Arrays              //
+// ------------------------------------------ //
+
+void TriangleArrays::push_back(const Vec3& v0, const Vec3& edge0, const Vec3& edge1, uint32_t triangleIndex) {
+	v0x.push_back(v0.x);
+	v0y.push_back(v0.y);
+	v0z.push_back(v0.z);
+	edge0x.push_back(edge0.x);
+	edge0y.push_back(edge0.y);
+	edge0z.push_back(edge0.z);
+	edge1x.push_back(edge1.x);
+	edge1y.push_back(edge1.y);
+	edge1z.push_back(edge1.z);
+	triangleIndices.push_back(triangleIndex);
+}
+
+void TriangleArrays::pad() {
+	std::vector<float>* arrays[] = { &v0x, &v0y, &v0z, &edge0x, &edge0y, &edge0z, &edge1x, &edge1y, &edge1z };
+	for (std::vector<float>* array : arrays) {
+		array->resize(triangleIndices.size() + MAX_KERNEL_WIDTH, 0.0f);
+	}
+}
+
+size_t TriangleArrays::size() const {
+	return triangleIndices.size();
+}
+
+void TriangleArrays::writeCache(ModelCacheWriter& writer) const {
+	const std::vector<float>* arrays[] = { &v0x, &v0y, &v0z, &edge0x, &edge0y, &edge0z, &edge1x, &edge1y, &edge1z };
+	for (const std::vector<float>* array : arrays) {
+		writer.writeArray(*array);
+	}
+	writer.writeArray(triangleIndices);
+}
+
+bool TriangleArrays::readCache(ModelCacheReader& reader) {
+	std::vector<float>* arrays[] = { &v0x, &v0y, &v0z, &edge0x, &edge0y, &edge0z, &edge1x, &edge1y, &edge1z };
+	for (std::vector<float>* array : arrays) {
+		if (!reader.readArray(*array)) return false;
+	}
+	if (!reader.readArray(triangleIndices)) return false;
+	// The padding is cached along with the triangles, but a damaged file could still lack it
+	for (std::vector<float>* array : arrays) {
+		if (array->size() != triangleIndices.size() + MAX_KERNEL_WIDTH) return false;
+	}
+	return true;
+}
+
+// ------------------------------- //
+//               BVH               //
+// ------------------------------- //
+
+BVH::BVH(
+	const std::vector<Triangle>& _triangles,
+	Model* model,
+	BuildStrategies::BuildStrategy strategy,
+	int _width,
+	ThreadPool* threadPool)
+	: width(_width), modelOffset(model->getPosition()), builtCost(-1.0f) {
+	auto start = std::chrono::steady_clock::now();
+	BVHBuilder builder(_triangles, model, strategy, threadPool);
+	builder.build(nodes);
+	addTriangles(_triangles, builder.getTriangleOrder(), model);
+	finishBuild();
+	buildTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
+
+BVH::BVH(
+	TriangleFile& triangleFile,
+	Model* model,
+	BuildStrategies::BuildStrategy strategy,
+	int _width,
+	ThreadPool* threadPool,
+	size_t memoryLimit)
+	: width(_width), modelOffset(model->getPosition()), builtCost(-1.0f) {
+	auto start = std::chrono::steady_clock::now();
+	size_t maxTriangleNum = std::max((size_t)1, memoryLimit / BUILD_BYTES_PER_TRIANGLE);
+	if (triangleFile.size() > 0) buildStreamed(triangleFile, model, strategy, threadPool, maxTriangleNum, 0);
+	finishBuild();
+	buildTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint32_t BVH::buildStreamed(
+	TriangleFile& triangleFile,
+	Model* model,
+	BuildStrategies::BuildStrategy strategy,
+	ThreadPool* threadPool,
+	size_t maxTriangleNum,
+	int depth) {
+	std::vector<Triangle> batch;
+	AABB bounds, centerBounds;
+	triangleFile.rewind();
+	while (triangleFile.read(batch, STREAM_BATCH_SIZE)) {
+		for (const Triangle& triangle : batch) {
+			bounds.grow(getTriangleBounds(model, triangle));
+			centerBounds.grow(getTriangleCenter(model, triangle));
 		}
-		else {
-			rightPartitionTriangles.push_back(triangles[i]);
+	}
+	Vec3 centerExtent = centerBounds.getExtent();
+	int axis = centerExtent.x > centerExtent.y && centerExtent.x > centerExtent.z ? Axes::x : centerExtent.y > centerExtent.z ? Axes::y : Axes::z;
+	float extent = getAxisComponent(centerExtent, axis);
+	TriangleFile leftFile, rightFile;
+	if (triangleFile.size() <= maxTriangleNum || extent <= 0.0f || depth + 1 >= BVHBuilder::traversalStackSize
+		|| !leftFile.isOpen() || !rightFile.isOpen()) {
+		// Few enough triangles to build the rest of this subtree in memory
+		std::vector<Triangle> subtreeTriangles;
+		triangleFile.readAll(subtreeTriangles);
+		BVHBuilder builder(subtreeTriangles, model, strategy, threadPool);
+		std::vector<LinearBVHNode> subtreeNodes;
+		builder.build(subtreeNodes, depth);
+		uint32_t nodeIndex = nodes.size();
+		appendNodes(nodes, subtreeNodes, triangles.size());
+		addTriangles(subtreeTriangles, builder.getTriangleOrder(), model);
+		return nodeIndex;
+	}
+
+	// Count the triangle centers into bins along the axis they spread furthest on, and split
+	// between the bins that come closest to halving them. The first and last bins can't be
+	// empty, so splitting between any two bins leaves triangles on both sides
+	float binStart = getAxisComponent(centerBounds.min, axis);
+	float binScale = STREAM_BIN_NUM / extent;
+	auto getBin = [&](const Triangle& triangle) {
+		return std::min(STREAM_BIN_NUM - 1, (int)((getAxisComponent(getTriangleCenter(model, triangle), axis) - binStart) * binScale));
+	};
+	size_t binCounts[STREAM_BIN_NUM] = {};
+	triangleFile.rewind();
+	while (triangleFile.read(batch, STREAM_BATCH_SIZE)) {
+		for (const Triangle& triangle : batch) {
+			binCounts[getBin(triangle)]++;
+		}
+	}
+	size_t halfTriangleNum = triangleFile.size() / 2;
+	size_t leftCount = 0;
+	int splitBin = 0;
+	size_t bestDifference = (size_t)-1;
+	for (int i = 0; i < STREAM_BIN_NUM - 1; i++) {
+		leftCount += binCounts[i];
+		size_t difference = leftCount > halfTriangleNum ? leftCount - halfTriangleNum : halfTriangleNum - leftCount;
+		if (difference < bestDifference) {
+			bestDifference = difference;
+			splitBin = i;
+		}
+	}
+	std::vector<Triangle> leftBatch, rightBatch;
+	triangleFile.rewind();
+	while (triangleFile.read(batch, STREAM_BATCH_SIZE)) {
+		for (const Triangle& triangle : batch) {
+			if (getBin(triangle) <= splitBin) leftBatch.push_back(triangle);
+			else rightBatch.push_back(triangle);
 		}
+		leftFile.write(leftBatch);
+		rightFile.write(rightBatch);
+		leftBatch.clear();
+		rightBatch.clear();
 	}
+
+	uint32_t nodeIndex = nodes.size();
+	nodes.push_back(LinearBVHNode{ bounds, 0, 0 });
+	buildStreamed(leftFile, model, strategy, threadPool, maxTriangleNum, depth + 1);
+	leftFile.close();
+	uint32_t child1Index = buildStreamed(rightFile, model, strategy, threadPool, maxTriangleNum, depth + 1);
+	nodes[nodeIndex].offset = child1Index;
+	return nodeIndex;
 }
 
-void BVHNode::partition(Model* model) {
-	std::vector<Triangle> leftPartitionTriangles;
-	std::vector<Triangle> rightPartitionTriangles;
-	Axes::Axes greatestVarianceAxis = calcAxisWithGreatestVariance();
-	switch (greatestVarianceAxis) {
-	case Axes::x:
-		partitionX(leftPartitionTriangles, rightPartitionTriangles);
-		break;
-	case Axes::y:
-		partitionY(leftPartitionTriangles, rightPartitionTriangles);
-		break;
-	case Axes::z:
-		partitionZ(leftPartitionTriangles, rightPartitionTriangles);
-		break;
+void BVH::addTriangles(const std::vector<Triangle>& source, const std::vector<uint32_t>& order, const Model* model) {
+	// Precompute the parts of each triangle the intersection test needs, in leaf order
+	for (int i = 0; i < order.size(); i++) {
+		const Triangle& triangle = source[order[i]];
+		Vec3 v0 = model->getVertex(triangle.getv0Index());
+		Vec3 v1 = model->getVertex(triangle.getv1Index());
+		Vec3 v2 = model->getVertex(triangle.getv2Index());
+		triangles.push_back(v0, v1 - v0, v2 - v0, triangle.getTriangleIndex());
 	}
+}
 
-	child0 = std::make_unique<BVHNode>(leftPartitionTriangles, model);
-	child1 = std::make_unique<BVHNode>(rightPartitionTriangles, model);
+void BVH::finishBuild() {
+	triangles.pad();
+	// The binary nodes are kept alongside the wide ones, for the bounds and statistics
+	if (nodes.empty()) width = 2;
+	else if (width == 4) collapse(0, nodes4);
+	else if (width == 8) collapse(0, nodes8);
+	else width = 2;
 }
 
-BVHNode::BVHNode(const std::vector<Triangle> _triangles, Model* model)
-	: triangles(_triangles) {
-	calcBounds(model);
-	build(model);
-	modelOffset = model->getPosition();
+template <int nodeWidth>
+uint32_t BVH::collapse(uint32_t nodeIndex, std::vector<WideBVHNode<nodeWidth>>& wideNodes) const {
+	// Starting from the node itself, repeatedly replace the interior child with the largest
+	// surface area by its two children, as it is the one most likely to be hit
+	uint32_t children[nodeWidth] = { nodeIndex };
+	int childNum = 1;
+	while (childNum < nodeWidth) {
+		int bestChild = -1;
+		float bestArea = -1.0f;
+		for (int i = 0; i < childNum; i++) {
+			const LinearBVHNode& child = nodes[children[i]];
+			if (child.triangleNum == 0 && child.bounds.getSurfaceArea() > bestArea) {
+				bestChild = i;
+				bestArea = child.bounds.getSurfaceArea();
+			}
+		}
+		if (bestChild == -1) break;
+		uint32_t openedIndex = children[bestChild];
+		children[bestChild] = openedIndex + 1;
+		children[childNum++] = nodes[openedIndex].offset;
+	}
+
+	uint32_t wideIndex = wideNodes.size();
+	wideNodes.push_back(WideBVHNode<nodeWidth>());
+	wideNodes[wideIndex].childNum = childNum;
+	for (int i = 0; i < nodeWidth; i++) {
+		// Unused slots are given empty boxes, although traversal never tests them
+		const LinearBVHNode& child = i < childNum ? nodes[children[i]] : LinearBVHNode{ AABB(), 0, 0 };
+		uint32_t offset = child.offset;
+		if (i < childNum && child.triangleNum == 0) {
+			// Collapsing the child may reallocate the node array, so the result is only stored afterwards
+			offset = collapse(children[i], wideNodes);
+		}
+		WideBVHNode<nodeWidth>& wideNode = wideNodes[wideIndex];
+		wideNode.minX[i] = child.bounds.min.x;
+		wideNode.minY[i] = child.bounds.min.y;
+		wideNode.minZ[i] = child.bounds.min.z;
+		wideNode.maxX[i] = child.bounds.max.x;
+		wideNode.maxY[i] = child.bounds.max.y;
+		wideNode.maxZ[i] = child.bounds.max.z;
+		wideNode.offsets[i] = offset;
+		wideNode.triangleNums[i] = child.triangleNum;
+	}
+	return wideIndex;
 }
 
-void BVHNode::build(Model* model) {
-	isLeaf = true;
-	if (triangles.size() > minTriangleNumPerLeaf) {
-		partition(model);
-		// Free memory
-		std::vector<Triangle>().swap(triangles);
-		triangles.clear();
-		isLeaf = false;
+float BVH::refit(const Model* model, ThreadPool* threadPool) {
+	if (nodes.empty()) return 1.0f;
+	if (builtCost < 0.0f) builtCost = calcSAHCost();
+	refitNode(0, nodes.size(), model, threadPool);
+	// Which binary nodes are opened into a wide node depends on their surface areas, so the wide
+	// nodes are collapsed again rather than refitted
+	if (width == 4) {
+		nodes4.clear();
+		collapse(0, nodes4);
 	}
+	else if (width == 8) {
+		nodes8.clear();
+		collapse(0, nodes8);
+	}
+	return builtCost > 0.0f ? calcSAHCost() / builtCost : 1.0f;
 }
 
-bool BVHNode::raySphereIntersection(const Ray& ray) {
-	float t0, t1;
-	const float radius2 = radius * radius;
-	const Vec3 l = center + modelOffset - ray.getOrigin();
-	const float tca = l.dot(ray.getDirection());
-	const float d2 = l.dot(l) - tca * tca;
-	if (d2 > radius2) return false; // Ray doesn't intersect with sphere
-	const float thc = sqrt(radius2 - d2);
-	t0 = tca - thc;
-	t1 = tca + thc;
+void BVH::refitNode(uint32_t nodeIndex, uint32_t end, const Model* model, ThreadPool* threadPool) {
+	LinearBVHNode& node = nodes[nodeIndex];
+	if (node.triangleNum > 0) {
+		// The triangles of a leaf belong to it alone, so leaves can be refitted in parallel
+		AABB bounds;
+		for (uint32_t i = node.offset; i < node.offset + node.triangleNum; i++) {
+			Triangle triangle = model->getTriangle(triangles.triangleIndices[i]);
+			Vec3 v0 = model->getVertex(triangle.getv0Index());
+			Vec3 v1 = model->getVertex(triangle.getv1Index());
+			Vec3 v2 = model->getVertex(triangle.getv2Index());
+			triangles.v0x[i] = v0.x;
+			triangles.v0y[i] = v0.y;
+			triangles.v0z[i] = v0.z;
+			triangles.edge0x[i] = v1.x - v0.x;
+			triangles.edge0y[i] = v1.y - v0.y;
+			triangles.edge0z[i] = v1.z - v0.z;
+			triangles.edge1x[i] = v2.x - v0.x;
+			triangles.edge1y[i] = v2.y - v0.y;
+			triangles.edge1z[i] = v2.z - v0.z;
+			bounds.grow(v0);
+			bounds.grow(v1);
+			bounds.grow(v2);
+		}
+		node.bounds = bounds;
+		return;
+	}
+	// The first child's subtree fills the nodes up to the second child
+	uint32_t child0Index = nodeIndex + 1;
+	uint32_t child1Index = node.offset;
+	if (threadPool != nullptr && threadPool->getThreadNum() > 1 && end - nodeIndex >= minParallelRefitNodeNum) {
+		TaskGroup group;
+		threadPool->submit(group, [&]() { refitNode(child0Index, child1Index, model, threadPool); });
+		refitNode(child1Index, end, model, threadPool);
+		threadPool->wait(group);
+	}
+	else {
+		refitNode(child0Index, child1Index, model, threadPool);
+		refitNode(child1Index, end, model, threadPool);
+	}
+	AABB bounds = nodes[child0Index].bounds;
+	bounds.grow(nodes[child1Index].bounds);
+	node.bounds = bounds;
+}
+
+float BVH::calcSAHCost() const {
+	if (nodes.empty()) return 0.0f;
+	if (width == 4) return calcSAHCost(nodes4, 0, nodes[0].bounds.getSurfaceArea());
+	if (width == 8) return calcSAHCost(nodes8, 0, nodes[0].bounds.getSurfaceArea());
+	return calcSAHCost(0);
+}
 
-	if (t0 > t1) std::swap(t0, t1);
-	if (t0 < 0) {
-		t0 = t1; // If t0 is negative, use t1 instead
-		if (t0 < 0) return false; // Both t0 and t1 are negative
+template <int nodeWidth>
+float BVH::calcSAHCost(const std::vector<WideBVHNode<nodeWidth>>& wideNodes, uint32_t nodeIndex, float area) const {
+	// A wide node costs one traversal step, however many children it has
+	const WideBVHNode<nodeWidth>& node = wideNodes[nodeIndex];
+	float cost = BVHBuilder::sahTraversalCost;
+	for (int i = 0; i < node.childNum; i++) {
+		AABB childBounds = AABB(
+			Vec3(node.minX[i], node.minY[i], node.minZ[i]),
+			Vec3(node.maxX[i], node.maxY[i], node.maxZ[i]));
+		float childArea = childBounds.getSurfaceArea();
+		float childCost = node.triangleNums[i] > 0
+			? BVHBuilder::sahIntersectionCost * node.triangleNums[i]
+			: calcSAHCost(wideNodes, node.offsets[i], childArea);
+		cost += childArea * childCost / area;
 	}
-	return true;
+	return cost;
+}
+
+float BVH::calcSAHCost(uint32_t nodeIndex) const {
+	const LinearBVHNode& node = nodes[nodeIndex];
+	if (node.triangleNum > 0) {
+		return BVHBuilder::sahIntersectionCost * node.triangleNum;
+	}
+	// The chance of a ray that hits this node's bounding box also
+	// hitting a child's is the ratio of their surface areas
+	const LinearBVHNode& child0 = nodes[nodeIndex + 1];
+	const LinearBVHNode& child1 = nodes[node.offset];
+	return BVHBuilder::sahTraversalCost
+		+ (child0.bounds.getSurfaceArea() * calcSAHCost(nodeIndex + 1)
+		+ child1.bounds.getSurfaceArea() * calcSAHCost(node.offset)) / node.bounds.getSurfaceArea();
+}
+
+int BVH::getNodeNum() const {
+	if (width == 4) return nodes4.size();
+	if (width == 8) return nodes8.size();
+	return nodes.size();
+}
+
+int BVH::getWidth() const {
+	return width;
+}
+
+float BVH::getBuildTime() const {
+	return buildTime;
+}
+
+void BVH::writeCache(ModelCacheWriter& writer) const {
+	writer.writeValue(width);
+	writer.writeArray(nodes);
+	writer.writeArray(nodes4);
+	writer.writeArray(nodes8);
+	triangles.writeCache(writer);
 }
 
-bool BVHNode::rayTrianglesIntersection(const Ray& ray, float& t, int& triangleIndex) {
+bool BVH::readCache(ModelCacheReader& reader, Model* model) {
+	modelOffset = model->getPosition();
+	buildTime = 0.0f;
+	builtCost = -1.0f;
+	return reader.readValue(width)
+		&& reader.readArray(nodes)
+		&& reader.readArray(nodes4)
+		&& reader.readArray(nodes8)
+		&& triangles.readCache(reader);
+}
+
+void BVH::setSIMDLevel(SIMDLevels::SIMDLevel level) {
+	triangleKernel = getTriangleKernel(level);
+}
+
+SIMDLevels::SIMDLevel BVH::getSIMDLevel() {
+	return triangleKernel.level;
+}
+
+AABB BVH::getBounds() const {
+	if (nodes.empty()) return AABB();
+	return AABB(nodes[0].bounds.min + modelOffset, nodes[0].bounds.max + modelOffset);
+}
+
+template <QueryTypes::QueryType queryType>
+bool BVH::rayTrianglesIntersection(uint32_t first, uint32_t triangleNum, const Vec3& rayOrigin, const Vec3& rayDirection, float& t, int& triangleIndex) const {
 	bool isIntersection = false;
-	for (int i = 0; i < triangles.size(); i++) {
-		float dist = MAX_DIST;
-		if (triangles[i].rayIntersection(ray, modelOffset, dist)) {
-			if (dist < t) {
-				t = dist;
-				triangleIndex = triangles[i].getTriangleIndex();
+	float dists[MAX_KERNEL_WIDTH];
+	uint32_t end = first + triangleNum;
+	for (uint32_t start = first; start < end; start += triangleKernel.width) {
+		int count = std::min(triangleKernel.width, (int)(end - start));
+		COUNT_TRAVERSAL(triangleTests, count);
+		int hitMask = triangleKernel.function(triangles, start, count, rayOrigin, rayDirection, dists);
+		// Take hits in triangle order, so that ties go to the same triangle whichever kernel is used
+		for (int i = 0; hitMask != 0; i++, hitMask >>= 1) {
+			if ((hitMask & 1) && dists[i] < t) {
+				if (queryType == QueryTypes::anyHit) return true;
+				t = dists[i];
+				triangleIndex = triangles.triangleIndices[start + i];
 				isIntersection = true;
 			}
 		}
@@ -153,32 +655,300 @@ bool BVHNode::rayTrianglesIntersection(const Ray& ray, float& t, int& triangleIn
 	return isIntersection;
 }
 
-bool BVHNode::rayIntersection(const Ray& ray, float& t, int& triangleIndex) {
-	if (!raySphereIntersection(ray)) {
-		return false;
+bool BVH::rayIntersection(const Ray& ray, float& t, int& triangleIndex) const {
+	return rayQuery<QueryTypes::closestHit>(ray, t, triangleIndex);
+}
+
+bool BVH::isOccluded(const Ray& ray, float tMax) const {
+	int triangleIndex;
+	return rayQuery<QueryTypes::anyHit>(ray, tMax, triangleIndex);
+}
+
+template <QueryTypes::QueryType queryType>
+bool BVH::rayQuery(const Ray& ray, float& t, int& triangleIndex) const {
+	if (nodes.empty()) return false;
+	// Boxes and triangles are stored relative to the model, so move the ray origin instead
+	const Vec3 origin = ray.getOrigin() - modelOffset;
+	const Vec3 direction = ray.getDirection();
+	const Vec3 invDirection = ray.getInvDirection();
+	float tEntry;
+	COUNT_TRAVERSAL(boxTests, 1);
+	if (!nodes[0].bounds.rayIntersection(origin, invDirection, t, tEntry)) return false;
+	if (width == 4) return rayIntersectionWide<queryType>(nodes4, origin, direction, invDirection, tEntry, t, triangleIndex);
+	if (width == 8) return rayIntersectionWide<queryType>(nodes8, origin, direction, invDirection, tEntry, t, triangleIndex);
+	return rayIntersection<queryType>(0, origin, direction, invDirection, t, triangleIndex);
+}
+
+template <QueryTypes::QueryType queryType>
+bool BVH::rayIntersection(uint32_t nodeIndex, const Vec3& origin, const Vec3& direction, const Vec3& invDirection, float& t, int& triangleIndex) const {
+	// Far children still to be visited, with the distance the ray enters them at
+	TraversalEntry stack[BVHBuilder::traversalStackSize];
+	int stackSize = 0;
+	bool isIntersection = false;
+	while (true) {
+		const LinearBVHNode& node = nodes[nodeIndex];
+		COUNT_TRAVERSAL(nodesVisited, 1);
+		if (node.triangleNum > 0) {
+			isIntersection |= rayTrianglesIntersection<queryType>(node.offset, node.triangleNum, origin, direction, t, triangleIndex);
+			if (queryType == QueryTypes::anyHit && isIntersection) return true;
+		}
+		else {
+			uint32_t childIndex0 = nodeIndex + 1;
+			uint32_t childIndex1 = node.offset;
+			float tEntry0, tEntry1;
+			COUNT_TRAVERSAL(boxTests, 2);
+			bool isHit0 = nodes[childIndex0].bounds.rayIntersection(origin, invDirection, t, tEntry0);
+			bool isHit1 = nodes[childIndex1].bounds.rayIntersection(origin, invDirection, t, tEntry1);
+			if (isHit0 && isHit1) {
+				// Visit the nearer child first, so any hit in it can rule out the farther child. Any hit
+				// will do for any-hit queries, so they skip the comparison
+				if (queryType == QueryTypes::closestHit && tEntry1 < tEntry0) {
+					std::swap(childIndex0, childIndex1);
+					std::swap(tEntry0, tEntry1);
+				}
+				stack[stackSize++] = TraversalEntry{ childIndex1, tEntry1 };
+				nodeIndex = childIndex0;
+				continue;
+			}
+			else if (isHit0 || isHit1) {
+				nodeIndex = isHit0 ? childIndex0 : childIndex1;
+				continue;
+			}
+		}
+		// Skip any stacked nodes the ray only enters beyond the closest hit found since they were pushed
+		while (stackSize > 0 && stack[stackSize - 1].tEntry >= t) {
+			stackSize--;
+		}
+		if (stackSize == 0) break;
+		nodeIndex = stack[--stackSize].nodeIndex;
+	}
+	return isIntersection;
+}
+
+// -------------------------------------------- //
+//               Packet Traversal               //
+// -------------------------------------------- //
+
+uint64_t BVH::rayPacketIntersection(RayPacket& packet, uint64_t rayMask) const {
+	if (nodes.empty()) return 0;
+	const Vec3 origin = packet.origin - modelOffset;
+	float tEntries0[RayPacket::maxRayNum];
+	float tEntries1[RayPacket::maxRayNum];
+	// Packets are counted as the work each of their rays would have done, as if traced on its own
+	COUNT_TRAVERSAL(boxTests, countRays(rayMask));
+	rayMask = rayPacketBoxIntersection(nodes[0].bounds, origin, packet, rayMask, tEntries0);
+	// Packets share each node fetch between their rays, which stops paying off once
+	// most of the rays have left, so those are traced on their own from there on
+	const int minRayNum = std::max(2, packet.rayNum / PACKET_SPLIT_RATIO);
+	PacketTraversalEntry stack[BVHBuilder::traversalStackSize];
+	int stackSize = 0;
+	uint32_t nodeIndex = 0;
+	uint64_t hitMask = 0;
+	while (rayMask != 0) {
+		const LinearBVHNode& node = nodes[nodeIndex];
+		if (countRays(rayMask) < minRayNum) {
+			for (int i = 0; i < packet.rayNum; i++) {
+				if (!(rayMask & ((uint64_t)1 << i))) continue;
+				if (rayIntersection<QueryTypes::closestHit>(nodeIndex, origin, packet.getDirection(i), packet.getInvDirection(i), packet.t[i], packet.triangleIndices[i])) {
+					hitMask |= (uint64_t)1 << i;
+				}
+			}
+		}
+		else if (node.triangleNum > 0) {
+			COUNT_TRAVERSAL(nodesVisited, countRays(rayMask));
+			COUNT_TRAVERSAL(triangleTests, node.triangleNum * countRays(rayMask));
+			hitMask |= rayPacketTrianglesIntersection(triangles, node.offset, node.triangleNum, origin, packet, rayMask);
+		}
+		else {
+			uint32_t childIndex0 = nodeIndex + 1;
+			uint32_t childIndex1 = node.offset;
+			COUNT_TRAVERSAL(nodesVisited, countRays(rayMask));
+			COUNT_TRAVERSAL(boxTests, 2 * countRays(rayMask));
+			uint64_t rayMask0 = rayPacketBoxIntersection(nodes[childIndex0].bounds, origin, packet, rayMask, tEntries0);
+			uint64_t rayMask1 = rayPacketBoxIntersection(nodes[childIndex1].bounds, origin, packet, rayMask, tEntries1);
+			if (rayMask0 != 0 && rayMask1 != 0) {
+				// Visit first whichever child the first ray hitting both enters first
+				uint64_t bothMask = rayMask0 & rayMask1;
+				if (bothMask != 0) {
+					int ray = 0;
+					while (!(bothMask & ((uint64_t)1 << ray))) ray++;
+					if (tEntries1[ray] < tEntries0[ray]) {
+						std::swap(childIndex0, childIndex1);
+						std::swap(rayMask0, rayMask1);
+					}
+				}
+				stack[stackSize++] = PacketTraversalEntry{ childIndex1, rayMask1 };
+				nodeIndex = childIndex0;
+				rayMask = rayMask0;
+				continue;
+			}
+			else if (rayMask0 != 0 || rayMask1 != 0) {
+				nodeIndex = rayMask0 != 0 ? childIndex0 : childIndex1;
+				rayMask = rayMask0 | rayMask1;
+				continue;
+			}
+		}
+		if (stackSize == 0) break;
+		stackSize--;
+		nodeIndex = stack[stackSize].nodeIndex;
+		rayMask = stack[stackSize].rayMask;
 	}
-	else if (isLeaf) {
-		return rayTrianglesIntersection(ray, t, triangleIndex);
+	return hitMask;
+}
+
+// ------------------------------------------ //
+//               Wide Traversal               //
+// ------------------------------------------ //
+
+// Slab test of a ray against every child of a wide node, one at a time. Sets the entry distance of
+// each child, and returns a bitmask of the children hit before 't', with bit i set for child i
+template <int nodeWidth>
+static int rayChildrenIntersectionScalar(const WideBVHNode<nodeWidth>& node, const Vec3& origin, const Vec3& invDirection, float t, float* tEntries) {
+	int hitMask = 0;
+	for (int i = 0; i < node.childNum; i++) {
+		AABB bounds = AABB(
+			Vec3(node.minX[i], node.minY[i], node.minZ[i]),
+			Vec3(node.maxX[i], node.maxY[i], node.maxZ[i]));
+		if (bounds.rayIntersection(origin, invDirection, t, tEntries[i])) {
+			hitMask |= 1 << i;
+		}
 	}
-	else {
-		return recurseRayIntersection(ray, t, triangleIndex);
+	return hitMask;
+}
+
+#if SIMD_X86
+
+// The vector slab tests match AABB::rayIntersection exactly. std::min(a, b) and std::max(a, b)
+// return 'a' when either is NaN (from a ray parallel to a box face), as do _mm_min_ps(b, a) and
+// _mm_max_ps(b, a), hence their operands being swapped
+
+// Slab test of four consecutive children, starting from child 'first'
+template <int nodeWidth>
+static int rayChildrenIntersectionSSE(const WideBVHNode<nodeWidth>& node, int first, const Vec3& origin, const Vec3& invDirection, float t, float* tEntries) {
+	const __m128 originX = _mm_set1_ps(origin.x);
+	const __m128 originY = _mm_set1_ps(origin.y);
+	const __m128 originZ = _mm_set1_ps(origin.z);
+	const __m128 invDirX = _mm_set1_ps(invDirection.x);
+	const __m128 invDirY = _mm_set1_ps(invDirection.y);
+	const __m128 invDirZ = _mm_set1_ps(invDirection.z);
+	__m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.minX[first]), originX), invDirX);
+	__m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.minY[first]), originY), invDirY);
+	__m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.minZ[first]), originZ), invDirZ);
+	__m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.maxX[first]), originX), invDirX);
+	__m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.maxY[first]), originY), invDirY);
+	__m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.maxZ[first]), originZ), invDirZ);
+	__m128 tNear = _mm_max_ps(_mm_min_ps(t1z, t0z), _mm_max_ps(_mm_min_ps(t1y, t0y), _mm_min_ps(t1x, t0x)));
+	__m128 tFar = _mm_min_ps(_mm_max_ps(t1z, t0z), _mm_min_ps(_mm_max_ps(t1y, t0y), _mm_max_ps(t1x, t0x)));
+	__m128 hit = _mm_and_ps(
+		_mm_and_ps(_mm_cmple_ps(tNear, tFar), _mm_cmpge_ps(tFar, _mm_setzero_ps())),
+		_mm_cmplt_ps(tNear, _mm_set1_ps(t)));
+	_mm_storeu_ps(tEntries + first, tNear);
+	return _mm_movemask_ps(hit) << first;
+}
+
+TARGET_AVX2
+static int rayChildrenIntersectionAVX2(const WideBVHNode<8>& node, const Vec3& origin, const Vec3& invDirection, float t, float* tEntries) {
+	const __m256 originX = _mm256_set1_ps(origin.x);
+	const __m256 originY = _mm256_set1_ps(origin.y);
+	const __m256 originZ = _mm256_set1_ps(origin.z);
+	const __m256 invDirX = _mm256_set1_ps(invDirection.x);
+	const __m256 invDirY = _mm256_set1_ps(invDirection.y);
+	const __m256 invDirZ = _mm256_set1_ps(invDirection.z);
+	__m256 t0x = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minX), originX), invDirX);
+	__m256 t0y = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minY), originY), invDirY);
+	__m256 t0z = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minZ), originZ), invDirZ);
+	__m256 t1x = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxX), originX), invDirX);
+	__m256 t1y = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxY), originY), invDirY);
+	__m256 t1z = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxZ), originZ), invDirZ);
+	__m256 tNear = _mm256_max_ps(_mm256_min_ps(t1z, t0z), _mm256_max_ps(_mm256_min_ps(t1y, t0y), _mm256_min_ps(t1x, t0x)));
+	__m256 tFar = _mm256_min_ps(_mm256_max_ps(t1z, t0z), _mm256_min_ps(_mm256_max_ps(t1y, t0y), _mm256_max_ps(t1x, t0x)));
+	__m256 hit = _mm256_and_ps(
+		_mm256_and_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ), _mm256_cmp_ps(tFar, _mm256_setzero_ps(), _CMP_GE_OQ)),
+		_mm256_cmp_ps(tNear, _mm256_set1_ps(t), _CMP_LT_OQ));
+	_mm256_storeu_ps(tEntries, tNear);
+	return _mm256_movemask_ps(hit);
+}
+
+#endif
+
+// Test every child of a wide node with the widest instruction set available
+static int rayChildrenIntersection(const WideBVHNode<4>& node, const Vec3& origin, const Vec3& invDirection, float t, float* tEntries) {
+#if SIMD_X86
+	if (BVH::getSIMDLevel() >= SIMDLevels::sse) {
+		// Unused slots may still pass the test, so are masked out
+		return rayChildrenIntersectionSSE(node, 0, origin, invDirection, t, tEntries) & ((1 << node.childNum) - 1);
 	}
+#endif
+	return rayChildrenIntersectionScalar(node, origin, invDirection, t, tEntries);
 }
 
-bool BVHNode::recurseRayIntersection(const Ray& ray, float& t, int& triangleIndex) {
-	int triangleIndex0 = -1;
-	int triangleIndex1 = -1;
-	float dist0 = MAX_DIST * 2;
-	float dist1 = MAX_DIST * 2;
-	bool isIntersect0 = child0->rayIntersection(ray, dist0, triangleIndex0);
-	bool isIntersect1 = child1->rayIntersection(ray, dist1, triangleIndex1);
-	if (dist0 > dist1) {
-		std::swap(dist0, dist1);
-		std::swap(triangleIndex0, triangleIndex1);
+static int rayChildrenIntersection(const WideBVHNode<8>& node, const Vec3& origin, const Vec3& invDirection, float t, float* tEntries) {
+#if SIMD_X86
+	if (BVH::getSIMDLevel() >= SIMDLevels::avx2) {
+		return rayChildrenIntersectionAVX2(node, origin, invDirection, t, tEntries) & ((1 << node.childNum) - 1);
 	}
-	if (dist0 < t) {
-		t = dist0;
-		triangleIndex = triangleIndex0;
+	if (BVH::getSIMDLevel() >= SIMDLevels::sse) {
+		int hitMask = rayChildrenIntersectionSSE(node, 0, origin, invDirection, t, tEntries);
+		if (node.childNum > 4) hitMask |= rayChildrenIntersectionSSE(node, 4, origin, invDirection, t, tEntries);
+		return hitMask & ((1 << node.childNum) - 1);
+	}
+#endif
+	return rayChildrenIntersectionScalar(node, origin, invDirection, t, tEntries);
+}
+
+template <QueryTypes::QueryType queryType, int nodeWidth>
+bool BVH::rayIntersectionWide(
+	const std::vector<WideBVHNode<nodeWidth>>& wideNodes,
+	const Vec3& origin,
+	const Vec3& direction,
+	const Vec3& invDirection,
+	float tRoot,
+	float& t,
+	int& triangleIndex) const {
+	// Each node visited replaces its own entry with at most one per child, so the
+	// stack grows by at most nodeWidth - 1 entries for every level of the tree
+	WideTraversalEntry stack[(nodeWidth - 1) * BVHBuilder::traversalStackSize + 1];
+	int stackSize = 0;
+	stack[stackSize++] = WideTraversalEntry{ 0, 0, tRoot };
+	bool isIntersection = false;
+	while (stackSize > 0) {
+		const WideTraversalEntry entry = stack[--stackSize];
+		// Skip anything the ray only enters beyond the closest hit found since it was pushed
+		if (entry.tEntry >= t) continue;
+		COUNT_TRAVERSAL(nodesVisited, 1);
+		if (entry.triangleNum > 0) {
+			isIntersection |= rayTrianglesIntersection<queryType>(entry.offset, entry.triangleNum, origin, direction, t, triangleIndex);
+			if (queryType == QueryTypes::anyHit && isIntersection) return true;
+			continue;
+		}
+		const WideBVHNode<nodeWidth>& node = wideNodes[entry.offset];
+		float tEntries[nodeWidth];
+		COUNT_TRAVERSAL(boxTests, node.childNum);
+		int hitMask = rayChildrenIntersection(node, origin, invDirection, t, tEntries);
+		if (queryType == QueryTypes::anyHit) {
+			// The order children are visited in doesn't matter when looking for any hit
+			for (int i = 0; hitMask != 0; i++, hitMask >>= 1) {
+				if (hitMask & 1) stack[stackSize++] = WideTraversalEntry{ node.offsets[i], node.triangleNums[i], tEntries[i] };
+			}
+			continue;
+		}
+		// Sort the children that were hit by entry distance, farthest first
+		int hitChildren[nodeWidth];
+		int hitNum = 0;
+		for (int i = 0; hitMask != 0; i++, hitMask >>= 1) {
+			if (!(hitMask & 1)) continue;
+			int j = hitNum++;
+			while (j > 0 && tEntries[hitChildren[j - 1]] < tEntries[i]) {
+				hitChildren[j] = hitChildren[j - 1];
+				j--;
+			}
+			hitChildren[j] = i;
+		}
+		// Push them farthest first, so that the nearest child is visited next
+		for (int i = 0; i < hitNum; i++) {
+			int child = hitChildren[i];
+			stack[stackSize++] = WideTraversalEntry{ node.offsets[child], node.triangleNums[child], tEntries[child] };
+		}
 	}
-	return isIntersect0 || isIntersect1;
-}
\ No newline at end of file
+	return isIntersection;
+}
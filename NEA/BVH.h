@@ -2,9 +2,33 @@
 
 struct Model;
 struct Triangle;
+struct ThreadPool;
+struct ModelCacheWriter;
+struct ModelCacheReader;
+struct TriangleFile;
 
+#include <vector>
+#include <memory>
+#include <stdint.h>
 #include "geometry.h"
-#include "model.h"
+#include "trianglekernels.h"
+#include "raypacket.h"
+
+namespace BuildStrategies {
+	enum BuildStrategy {
+		centroidMean, // Split at the mean triangle center, on the axis with the greatest variance
+		sah           // Split at the cheapest of a set of binned planes, costed by the surface area heuristic
+	};
+}
+
+// What a traversal looks for. Each traversal is compiled separately for each type of query, so that
+// any-hit queries carry none of the ordering and bookkeeping closest-hit queries need
+namespace QueryTypes {
+	enum QueryType {
+		closestHit, // The nearest hit along the ray, and what was hit
+		anyHit      // Whether anything is hit at all, stopping at the first hit found
+	};
+}
 
 namespace Axes {
 	enum Axes {
@@ -12,39 +36,216 @@ namespace Axes {
 	};
 }
 
-struct BVHNode {
+// Node of a flattened hierarchy. Nodes are stored in depth-first order,
+// so an interior node's first child always directly follows it
+struct LinearBVHNode {
+	AABB bounds;
+	// Index of the first triangle for leaves, or of the second child for interior nodes
+	uint32_t offset;
+	// Zero for interior nodes
+	uint32_t triangleNum;
+};
+
+// Node of a hierarchy collapsed to up to 'nodeWidth' children per node, so that a ray is tested
+// against all of a node's children at once. Child bounds are stored as structure-of-arrays,
+// so each component of every child's box can be loaded as a single vector
+template <int nodeWidth>
+struct WideBVHNode {
+	float minX[nodeWidth], minY[nodeWidth], minZ[nodeWidth];
+	float maxX[nodeWidth], maxY[nodeWidth], maxZ[nodeWidth];
+	// Index of the first triangle for leaf children, or of the node for interior children
+	uint32_t offsets[nodeWidth];
+	// Zero for interior children
+	uint32_t triangleNums[nodeWidth];
+	int childNum;
+};
+
+// Builds a hierarchy over a model's triangles in place, by reordering one array of triangle
+// indices so that the triangles under every node are a contiguous range of it. Subtrees
+// over enough triangles are built in parallel, as tasks on a thread pool
+struct BVHBuilder {
 private:
 	static constexpr int minTriangleNumPerLeaf = 3;
+	// Deepest a node can be, so that traversal can use a fixed-size stack
+	static constexpr int maxDepth = 64;
+	// Number of bins the triangle centers are sorted into along each axis, when building with the SAH
+	static constexpr int sahBinNum = 12;
+	// Subtrees over fewer triangles than this are built by the thread that reaches them
+	static constexpr uint32_t minParallelTriangleNum = 4096;
+
+	// Bounds and center of every triangle, indexed by its position in the model's triangle list
+	std::vector<AABB> triangleBounds;
+	std::vector<Vec3> triangleCenters;
+	// Positions of the triangles in the model's list, in the order the leaves refer to them
+	std::vector<uint32_t> triangleOrder;
+	// Scratch space the size of 'triangleOrder', for partitioning without allocating
+	std::vector<uint32_t> partitionBuffer;
+	BuildStrategies::BuildStrategy strategy;
+	ThreadPool* threadPool;
+
+	Axes::Axes calcAxisWithGreatestVariance(uint32_t start, uint32_t end) const;
+	// Move the triangles in a range that satisfy 'isLeft' to its start, keeping their order,
+	// and return the index of the first triangle that doesn't
+	template <typename Predicate>
+	uint32_t partition(uint32_t start, uint32_t end, Predicate isLeft);
+	// Each split returns where the second child's triangles begin, or 'start' if the node should be a leaf
+	uint32_t splitMean(uint32_t start, uint32_t end);
+	uint32_t splitSAH(uint32_t start, uint32_t end, const AABB& bounds);
+	// Append the subtree over a range of triangles in depth-first order, returning the index of its root
+	uint32_t buildNode(uint32_t start, uint32_t end, int depth, std::vector<LinearBVHNode>& nodes);
+public:
+	static constexpr int traversalStackSize = maxDepth;
+	// Estimated costs of testing a ray against a node's bounds and against a triangle
+	static constexpr float sahTraversalCost = 1.0f;
+	static constexpr float sahIntersectionCost = 1.0f;
 
-	std::unique_ptr<BVHNode> child0;
-	std::unique_ptr<BVHNode> child1;
-	std::vector<Triangle> triangles;
-	Vec3 center = Vec3();
+	BVHBuilder(
+		const std::vector<Triangle>& triangles,
+		const Model* model,
+		BuildStrategies::BuildStrategy _strategy = BuildStrategies::sah,
+		ThreadPool* _threadPool = nullptr);
+	// The root's depth is only non-zero when building part of a larger hierarchy
+	void build(std::vector<LinearBVHNode>& nodes, int rootDepth = 0);
+	const std::vector<uint32_t>& getTriangleOrder() const;
+};
+
+// Intersection-ready triangles, stored as structure-of-arrays in leaf order. Each holds its
+// first vertex and the two edges from it, so no vertex lookups are needed while tracing
+struct TriangleArrays {
+	std::vector<float> v0x, v0y, v0z;
+	std::vector<float> edge0x, edge0y, edge0z;
+	std::vector<float> edge1x, edge1y, edge1z;
+	// Index of each triangle in its model
+	std::vector<uint32_t> triangleIndices;
+
+	void push_back(const Vec3& v0, const Vec3& edge0, const Vec3& edge1, uint32_t triangleIndex);
+	// Add unused vertex data after the last triangle, so kernels can read whole vectors past it
+	void pad();
+	size_t size() const;
+	void writeCache(ModelCacheWriter& writer) const;
+	bool readCache(ModelCacheReader& reader);
+};
+
+// Bounding volume hierarchy over a model's triangles, flattened into one contiguous node
+// array, with each leaf referring to a range of a single shared array of triangles
+struct BVH {
+private:
+	std::vector<LinearBVHNode> nodes;
+	// The binary hierarchy collapsed to 4 or 8 children per node, when built with that width
+	std::vector<WideBVHNode<4>> nodes4;
+	std::vector<WideBVHNode<8>> nodes8;
+	int width;
+	TriangleArrays triangles;
 	Vec3 modelOffset;
-	float radius;
-	bool isLeaf;
-
-	void updateBoundRadius(Vec3 vertex);
-	void calcBounds(Model* Model);
-
-	Axes::Axes calcAxisWithGreatestVariance();
-	void partitionX(
-		std::vector<Triangle>& leftPartitionTriangles, 
-		std::vector<Triangle>& rightPartitionTriangles);
-	void partitionY(
-		std::vector<Triangle>& leftPartitionTriangles, 
-		std::vector<Triangle>& rightPartitionTriangles);
-	void partitionZ(
-		std::vector<Triangle>& leftPartitionTriangles, 
-		std::vector<Triangle>& rightPartitionTriangles);
-	void partition(Model* Model);
-
-	bool raySphereIntersection(const Ray& ray);
-	bool rayTrianglesIntersection(const Ray& ray, float& t, int& triangleIndex);
-	bool recurseRayIntersection(const Ray& ray, float& t, int& triangleIndex);
+	// Seconds taken to build the hierarchy
+	float buildTime;
+	// Cost of the hierarchy as built, measured before it is first refitted, or negative until then
+	float builtCost;
+	// Leaf intersection kernel shared by every hierarchy, picked from the CPU's instruction sets
+	static TriangleKernel triangleKernel;
+
+	// Node waiting to be visited during traversal
+	struct TraversalEntry {
+		uint32_t nodeIndex;
+		float tEntry;
+	};
+	// Node waiting to be visited by the rays of a packet that hit it
+	struct PacketTraversalEntry {
+		uint32_t nodeIndex;
+		uint64_t rayMask;
+	};
+	// Child of a wide node waiting to be visited, which may be a leaf
+	struct WideTraversalEntry {
+		uint32_t offset;
+		uint32_t triangleNum;
+		float tEntry;
+	};
+
+	// Collapse the binary subtree under a node into wide nodes, returning the index of its root
+	template <int nodeWidth>
+	uint32_t collapse(uint32_t nodeIndex, std::vector<WideBVHNode<nodeWidth>>& wideNodes) const;
+	template <QueryTypes::QueryType queryType, int nodeWidth>
+	bool rayIntersectionWide(
+		const std::vector<WideBVHNode<nodeWidth>>& wideNodes,
+		const Vec3& rayOrigin,
+		const Vec3& rayDirection,
+		const Vec3& invDirection,
+		float tRoot,
+		float& t,
+		int& triangleIndex) const;
+	template <int nodeWidth>
+	float calcSAHCost(const std::vector<WideBVHNode<nodeWidth>>& wideNodes, uint32_t nodeIndex, float area) const;
+	// Hit in the binary subtree under a node, which the ray is already known to hit. Any-hit
+	// queries leave 't' and 'triangleIndex' as they were
+	template <QueryTypes::QueryType queryType>
+	bool rayIntersection(uint32_t nodeIndex, const Vec3& rayOrigin, const Vec3& rayDirection, const Vec3& invDirection, float& t, int& triangleIndex) const;
+	template <QueryTypes::QueryType queryType>
+	bool rayTrianglesIntersection(uint32_t first, uint32_t triangleNum, const Vec3& rayOrigin, const Vec3& rayDirection, float& t, int& triangleIndex) const;
+	template <QueryTypes::QueryType queryType>
+	bool rayQuery(const Ray& ray, float& t, int& triangleIndex) const;
+	float calcSAHCost(uint32_t nodeIndex) const;
+	// Split the triangles in a file in two, to disk, until few enough remain to build each part in memory
+	uint32_t buildStreamed(
+		TriangleFile& triangleFile,
+		Model* model,
+		BuildStrategies::BuildStrategy strategy,
+		ThreadPool* threadPool,
+		size_t maxTriangleNum,
+		int depth);
+	// Add triangles to the triangle arrays, in the order given by indices into 'source'
+	void addTriangles(const std::vector<Triangle>& source, const std::vector<uint32_t>& order, const Model* model);
+	// Pad the triangle arrays, and collapse the hierarchy to the requested width
+	void finishBuild();
+	// Refit the subtree made of the nodes from 'nodeIndex' up to, but not including, 'end'
+	void refitNode(uint32_t nodeIndex, uint32_t end, const Model* model, ThreadPool* threadPool);
 public:
-	BVHNode(std::vector<Triangle> triangles, Model* Model);
-	void build(Model* Model);
+	// Subtrees of fewer nodes than this are refitted by the thread that reaches them
+	static constexpr uint32_t minParallelRefitNodeNum = 4096;
+	// Refitted hierarchies that cost more than this many times what they did as built are worth rebuilding
+	static constexpr float maxRefitCostRatio = 1.5f;
 
-	bool rayIntersection(const Ray& ray, float& t, int& triangleIndex);
-};
\ No newline at end of file
+	BVH();
+	BVH(
+		const std::vector<Triangle>& _triangles,
+		Model* model,
+		BuildStrategies::BuildStrategy strategy = BuildStrategies::sah,
+		int _width = 2,
+		ThreadPool* threadPool = nullptr);
+	// Build over triangles streamed from a file, holding about 'memoryLimit' bytes of building data at once.
+	// Subtrees too large for that are split in half spatially, to disk, before being built in memory
+	BVH(
+		TriangleFile& triangleFile,
+		Model* model,
+		BuildStrategies::BuildStrategy strategy,
+		int _width,
+		ThreadPool* threadPool,
+		size_t memoryLimit);
+
+	bool rayIntersection(const Ray& ray, float& t, int& triangleIndex) const;
+	// Whether the ray hits any triangle closer than 'tMax', for shadow rays
+	bool isOccluded(const Ray& ray, float tMax) const;
+	// Find the closest hits of the rays in 'rayMask', returning the rays that hit something closer than before
+	uint64_t rayPacketIntersection(RayPacket& packet, uint64_t rayMask) const;
+	// Expected cost of a ray query through the hierarchy, relative to hitting its root bounds
+	float calcSAHCost() const;
+	// Update the bounds of every node, and every triangle's intersection data, to the model's vertices
+	// as they are now, keeping which triangles are under which node. Far quicker than a rebuild, but
+	// the hierarchy gets worse the further the triangles move relative to each other, so this returns
+	// its cost afterwards divided by its cost as built
+	float refit(const Model* model, ThreadPool* threadPool = nullptr);
+	// Number of nodes a ray traverses, in the wide hierarchy if there is one
+	int getNodeNum() const;
+	int getWidth() const;
+	float getBuildTime() const;
+	// Store the built hierarchy in a model cache, or restore one from it without building
+	void writeCache(ModelCacheWriter& writer) const;
+	bool readCache(ModelCacheReader& reader, Model* model);
+	// Use the given instruction set for leaf intersection tests, or the widest the CPU supports below it
+	static void setSIMDLevel(SIMDLevels::SIMDLevel level);
+	static SIMDLevels::SIMDLevel getSIMDLevel();
+	// World-space bounds of every triangle in the hierarchy
+	AABB getBounds() const;
+};
+
+// Model holds its BVH by value, so is only defined once the BVH is complete
+#include "model.h"
@@ -0,0 +1,78 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include "batchrenderer.h"
+
+// Digits each view's number is padded to in its image's file name
+static constexpr int FRAME_NUMBER_DIGITS = 4;
+
+BatchRenderer::BatchRenderer(
+	std::shared_ptr<Scene> _scene,
+	std::shared_ptr<ThreadPool> _threadPool,
+	int _packetSize,
+	int _quality)
+	: scene(_scene), threadPool(_threadPool), packetSize(_packetSize), quality(_quality) {
+}
+
+bool BatchRenderer::render(const std::vector<View>& views, const FrameCallback& onFrame) {
+	// The top-level hierarchy is built before any views start, so they only ever read the scene
+	scene->build();
+	std::atomic<bool> isSuccess(true);
+	auto renderView = [&](int viewIndex) {
+		const View& view = views[viewIndex];
+		Camera cam(view.position, view.width, view.height, view.fov);
+		cam.setScene(scene);
+		cam.setThreadPool(threadPool);
+		cam.setPacketSize(packetSize);
+		cam.setRotation(view.yaw, view.pitch);
+		// Progress from views rendering at the same time would be interleaved, so none is printed
+		cam.setPrintsProgress(false);
+		Framebuffer framebuffer(view.width, view.height);
+		if (quality < Camera::maxQuality) cam.renderProgressive(framebuffer, quality);
+		else cam.renderImage(framebuffer);
+		if (!onFrame(viewIndex, framebuffer)) isSuccess = false;
+	};
+	// Each view's framebuffer is freed once its callback returns, so only the views in progress are held in memory
+	if (threadPool != nullptr && threadPool->getThreadNum() > 1) {
+		threadPool->parallelFor(views.size(), renderView);
+	}
+	else {
+		for (int i = 0; i < views.size(); i++) {
+			renderView(i);
+		}
+	}
+	return isSuccess;
+}
+
+void BatchRenderer::setPostProcess(const PostProcess& _postProcess) {
+	postProcess = _postProcess;
+}
+
+bool BatchRenderer::renderToFiles(const std::vector<View>& views, const std::string& outputPath) {
+	std::mutex printMutex;
+	auto start = std::chrono::steady_clock::now();
+	return render(views, [&](int viewIndex, const Framebuffer& framebuffer) {
+		std::string framePath = getFramePath(outputPath, viewIndex);
+		bool isWritten = framebuffer.writePPM(framePath, postProcess, threadPool.get());
+		float timeTaken = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+		std::lock_guard<std::mutex> lock(printMutex);
+		std::cout << "View " << viewIndex + 1 << "/" << views.size() << (isWritten ? " written to " : " could not be written to ")
+			<< framePath << " : " << timeTaken << " Seconds taken\n";
+		return isWritten;
+	});
+}
+
+std::string BatchRenderer::getFramePath(const std::string& outputPath, int viewIndex) {
+	std::ostringstream number;
+	number << "_" << std::setw(FRAME_NUMBER_DIGITS) << std::setfill('0') << viewIndex;
+	// Only a dot after the last directory separator starts an extension
+	size_t dot = outputPath.find_last_of('.');
+	size_t separator = outputPath.find_last_of("/\\");
+	if (dot == std::string::npos || (separator != std::string::npos && dot < separator)) {
+		return outputPath + number.str();
+	}
+	return outputPath.substr(0, dot) + number.str() + outputPath.substr(dot);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+#include "camera.h"
+#include "postprocess.h"
+
+// Where a view of a batch is rendered from, and the size and field of view of its image
+struct View {
+	Vec3 position;
+	// Direction faced in degrees, as taken by Camera::setRotation
+	float yaw = 0.0f;
+	float pitch = 0.0f;
+	float fov = 90.0f;
+	int width = 0;
+	int height = 0;
+};
+
+// Renders any number of views of one scene, so that its models are loaded and their hierarchies
+// built once for the whole batch rather than once per image. Views are rendered as tasks on the
+// thread pool, each tracing its own tiles on it too, so small images still keep every thread busy
+struct BatchRenderer {
+private:
+	std::shared_ptr<Scene> scene;
+	std::shared_ptr<ThreadPool> threadPool;
+	int packetSize;
+	int quality;
+	PostProcess postProcess;
+public:
+	// Called with each view's image as soon as it is rendered, from whichever thread rendered it, so
+	// may be called for several views at once. Returns false if the image couldn't be used
+	typedef std::function<bool(int viewIndex, const Framebuffer& framebuffer)> FrameCallback;
+
+	// 'quality' is the number of progressive passes each view is rendered with, as for Camera::renderProgressive
+	BatchRenderer(
+		std::shared_ptr<Scene> _scene,
+		std::shared_ptr<ThreadPool> _threadPool,
+		int _packetSize = 0,
+		int _quality = Camera::maxQuality);
+
+	// Render every view, returning false if any of their callbacks did
+	bool render(const std::vector<View>& views, const FrameCallback& onFrame);
+	// Exposure, tone curve and dithering the images are written with by 'renderToFiles'
+	void setPostProcess(const PostProcess& _postProcess);
+	// Render every view to a numbered image file, named by 'getFramePath'
+	bool renderToFiles(const std::vector<View>& views, const std::string& outputPath);
+	// Path of a view's image, made by numbering 'outputPath' before its extension, so that
+	// 'image.ppm' becomes 'image_0000.ppm', 'image_0001.ppm', and so on
+	static std::string getFramePath(const std::string& outputPath, int viewIndex);
+};
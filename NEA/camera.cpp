@@ -2,14 +2,41 @@
 #include <iostream>
 #include <chrono>
 #include <algorithm>
+#include <math.h>
 #include "camera.h"
 
 static constexpr float PI = 3.14159265;
 static constexpr float DEG2RAD = PI / 180;
 static constexpr float MAX_DIST = 1000000.0;
+// Width and height in rays of the square tiles each pass is split into when rendering in parallel
+static constexpr int TILE_SIZE = 16;
+// Pixels between rays in x and y in the first pass of a progressive render. Each pass halves it
+static constexpr int COARSEST_STRIDE = 1 << (Camera::maxQuality - 1);
+// Steepest the camera can look up or down, in degrees, short of vertical where yaw is lost
+static constexpr float MAX_PITCH = 89.0f;
+static const Vec3 BACKGROUND_COLOUR = Vec3(0.02, 0.02, 0.04);
+// Light reaching every surface in scenes with lights, so that shadows aren't completely black
+static const Vec3 AMBIENT_LIGHT = Vec3(0.05, 0.05, 0.05);
+// Distance shadow rays start off the surface, per unit of distance from the camera, so that rounding
+// errors in where the surface was hit can't make it shadow itself
+static constexpr float SHADOW_BIAS = 0.001f;
+
+// Whether a pixel on a pass's grid of rays is traced by that pass. Every other ray in x and y
+// was already traced by the pass before it, which had twice the stride
+static bool isTracedInPass(int x, int y, int stride, bool isFirstPass) {
+	return isFirstPass || x % (stride * 2) != 0 || y % (stride * 2) != 0;
+}
+
+// Number of rays a pass over a width by height image traces
+static int64_t countPassRays(int width, int height, int stride, bool isFirstPass) {
+	int64_t gridNum = (int64_t)((width + stride - 1) / stride) * ((height + stride - 1) / stride);
+	if (isFirstPass) return gridNum;
+	int coarseStride = stride * 2;
+	return gridNum - (int64_t)((width + coarseStride - 1) / coarseStride) * ((height + coarseStride - 1) / coarseStride);
+}
 
 Camera::Camera(Vec3 _position, int _pixelWidth, int _pixelHeight, float _horizontalFOV)
-	: position(_position), pixelWidth(_pixelWidth), pixelHeight(_pixelHeight) {
+	: position(_position), pixelWidth(_pixelWidth), pixelHeight(_pixelHeight), scene(std::make_shared<Scene>()) {
 	aspectRatio = pixelWidth / (float)pixelHeight;
 	float verticalFOV = _horizontalFOV / aspectRatio;
 	float halfFOV = _horizontalFOV / 2.0f;
@@ -19,114 +46,429 @@ Camera::Camera(Vec3 _position, int _pixelWidth, int _pixelHeight, float _horizon
 	halfPixelHeight = pixelHeight / 2;
 }
 
-void Camera::renderImage(SDL_Renderer* renderer, int screenWidth, int screenHeight) {
-	time_t start = time(0);
-	// Iterate over each pixel in the screen, emitting a ray for each
-	for (int y = 0; y < screenHeight; y++) {
-		for (int x = 0; x < screenWidth; x++) {
-			renderPixel(renderer, x, y);
+void Camera::beginFrame(const Framebuffer& framebuffer) {
+	// Make sure the top-level hierarchy covers every instance before any rays are traced
+	scene->build();
+	depths.assign(framebuffer.getWidth() * framebuffer.getHeight(), (float)MAX_DIST);
+	depthPosition = position;
+	depthOrientation = orientation;
+#if TRAVERSAL_STATS
+	traversalStats.reset(framebuffer.getWidth(), framebuffer.getHeight());
+#endif
+}
+
+void Camera::setDepth(const Framebuffer& framebuffer, int x, int y, int size, float t) {
+	int endX = std::min(x + size, framebuffer.getWidth());
+	int endY = std::min(y + size, framebuffer.getHeight());
+	for (int blockY = y; blockY < endY; blockY++) {
+		for (int blockX = x; blockX < endX; blockX++) {
+			depths[blockY * framebuffer.getWidth() + blockX] = t;
+		}
+	}
+}
+
+void Camera::renderImage(Framebuffer& framebuffer) {
+	beginFrame(framebuffer);
+	if (threadPool != nullptr && threadPool->getThreadNum() > 1) {
+		renderImageParallel(framebuffer);
+	}
+	else {
+		renderImageSerial(framebuffer);
+	}
+}
+
+void Camera::renderImageSerial(Framebuffer& framebuffer) {
+	int screenWidth = framebuffer.getWidth();
+	int screenHeight = framebuffer.getHeight();
+	auto start = std::chrono::steady_clock::now();
+	// Iterate over each pixel in the screen, emitting a ray for each. With packets, each
+	// row is a row of blocks, and one packet of rays is emitted for each block
+	int rowHeight = packetSize > 0 ? packetSize : 1;
+	int rowNum = (screenHeight + rowHeight - 1) / rowHeight;
+	for (int row = 0; row < rowNum; row++) {
+		int y = row * rowHeight;
+		for (int x = 0; x < screenWidth; x += rowHeight) {
+			if (packetSize > 0) tracePacket(framebuffer, x, y);
+			else {
+				float t;
+				framebuffer.setPixel(x, y, tracePixel(x, y, t));
+				setDepth(framebuffer, x, y, 1, t);
+#if TRAVERSAL_STATS
+				traversalStats.fillBlock(x, y, 1, threadTraversalCounts);
+#endif
+			}
 		}
 		// Calculate the time taken to render the row, and print it along with the number of the row
-		float timePerRow = difftime(time(0), start) / (y + 1);
-		float timeLeft = timePerRow * (screenHeight - y + 1);
-		std::cout << "Row " << y + 1 << "/" << screenHeight << " complete : " << (int)round(timeLeft) << " Seconds left\n";
-		// Update the screen with the new row
-		SDL_RenderPresent(renderer);
+		float timePerRow = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count() / (row + 1);
+		float timeLeft = timePerRow * (rowNum - row - 1);
+		if (printsProgress) std::cout << "Row " << row + 1 << "/" << rowNum << " complete : " << round(timeLeft * 10.0f) / 10.0f << " Seconds left\n";
+	}
+}
+
+void Camera::renderImageParallel(Framebuffer& framebuffer) {
+	if (printsProgress) std::cout << "Rendering " << getPassTileNum(framebuffer, 1) << " tiles on " << threadPool->getThreadNum() << " threads\n";
+	renderPass(framebuffer, 1, true);
+}
+
+void Camera::renderProgressive(Framebuffer& framebuffer, int quality, const PassCallback& onPass) {
+	beginFrame(framebuffer);
+	quality = std::max(1, std::min(quality, maxQuality));
+	int64_t rayNum = 0;
+	for (int pass = 0; pass < quality; pass++) {
+		rayNum += countPassRays(framebuffer.getWidth(), framebuffer.getHeight(), COARSEST_STRIDE >> pass, pass == 0);
+	}
+	auto start = std::chrono::steady_clock::now();
+	int64_t tracedRayNum = 0;
+	for (int pass = 0; pass < quality; pass++) {
+		int stride = COARSEST_STRIDE >> pass;
+		renderPass(framebuffer, stride, pass == 0);
+		// Later passes trace more rays, so the time left is estimated from the time taken per ray
+		tracedRayNum += countPassRays(framebuffer.getWidth(), framebuffer.getHeight(), stride, pass == 0);
+		float timeTaken = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+		float timeLeft = timeTaken / tracedRayNum * (rayNum - tracedRayNum);
+		if (printsProgress) std::cout << "Pass " << pass + 1 << "/" << quality << " complete (" << stride << "x" << stride << " pixels per ray) : "
+			<< timeTaken << " Seconds taken, " << timeLeft << " Seconds left\n";
+		if (onPass) onPass(framebuffer, pass, stride);
+	}
+}
+
+int Camera::getPassTileNum(const Framebuffer& framebuffer, int stride) const {
+	int tileSize = TILE_SIZE * stride;
+	int tilesX = (framebuffer.getWidth() + tileSize - 1) / tileSize;
+	int tilesY = (framebuffer.getHeight() + tileSize - 1) / tileSize;
+	return tilesX * tilesY;
+}
+
+void Camera::renderPass(Framebuffer& framebuffer, int stride, bool isFirstPass) {
+	// Each tile writes to a disjoint set of pixels, so the worker threads can share the framebuffer
+	int tileNum = getPassTileNum(framebuffer, stride);
+	if (threadPool != nullptr && threadPool->getThreadNum() > 1) {
+		threadPool->parallelFor(tileNum, [&](int tileIndex) {
+			renderTile(framebuffer, tileIndex, stride, isFirstPass);
+		});
+		return;
+	}
+	for (int tileIndex = 0; tileIndex < tileNum; tileIndex++) {
+		renderTile(framebuffer, tileIndex, stride, isFirstPass);
+	}
+}
+
+void Camera::renderTile(Framebuffer& framebuffer, int tileIndex, int stride, bool isFirstPass) {
+	// Tiles are numbered in rows from the top-left of the screen, and each covers
+	// TILE_SIZE rays in x and y, so spans further across the screen in coarser passes
+	int screenWidth = framebuffer.getWidth();
+	int screenHeight = framebuffer.getHeight();
+	int tileSize = TILE_SIZE * stride;
+	int tilesX = (screenWidth + tileSize - 1) / tileSize;
+	int startX = (tileIndex % tilesX) * tileSize;
+	int startY = (tileIndex / tilesX) * tileSize;
+	int endX = std::min(startX + tileSize, screenWidth);
+	int endY = std::min(startY + tileSize, screenHeight);
+	if (packetSize > 0) {
+		int blockSize = packetSize * stride;
+		for (int y = startY; y < endY; y += blockSize) {
+			for (int x = startX; x < endX; x += blockSize) {
+				tracePacket(framebuffer, x, y, stride, isFirstPass);
+			}
+		}
+		return;
+	}
+	// Each ray's colour fills the block of pixels it stands for until a finer pass traces them
+	for (int y = startY; y < endY; y += stride) {
+		for (int x = startX; x < endX; x += stride) {
+			if (isTracedInPass(x, y, stride, isFirstPass)) {
+				float t;
+				framebuffer.fillBlock(x, y, stride, tracePixel(x, y, t));
+				setDepth(framebuffer, x, y, stride, t);
+#if TRAVERSAL_STATS
+				traversalStats.fillBlock(x, y, stride, threadTraversalCounts);
+#endif
+			}
+		}
 	}
 }
 
-void Camera::renderPixel(SDL_Renderer* renderer, int pixelX, int pixelY) {
+Vec3 Camera::tracePixel(int pixelX, int pixelY, float& t) {
+	RESET_TRAVERSAL_COUNTS();
 	// Emit a ray into the scene, and get the colour of whatever it collides with
 	Ray ray = emitScreenRay(pixelX, pixelY);
-	Vec3 colour = getRayIntersectionColour(ray);
-	// Set the draw colour, and draw it to the required pixel
-	setDrawColour(renderer, colour);
-	SDL_RenderDrawPoint(renderer, pixelX, pixelY);
+	return getRayIntersectionColour(ray, t);
+}
+
+void Camera::tracePacket(Framebuffer& framebuffer, int startX, int startY, int stride, bool isFirstPass) {
+	// Blocks at the right and bottom edges of the screen may be cut short
+	int endX = std::min(startX + packetSize * stride, framebuffer.getWidth());
+	int endY = std::min(startY + packetSize * stride, framebuffer.getHeight());
+	RayPacket packet(position);
+	for (int y = startY; y < endY; y += stride) {
+		for (int x = startX; x < endX; x += stride) {
+			if (isTracedInPass(x, y, stride, isFirstPass)) {
+				packet.addRay(emitScreenRay(x, y), (float)MAX_DIST);
+			}
+		}
+	}
+	if (packet.rayNum == 0) return;
+	RESET_TRAVERSAL_COUNTS();
+	scene->rayPacketIntersection(packet);
+#if TRAVERSAL_STATS
+	// Each ray is counted an even share of the packet's traversal, and the shadow rays of its own hit
+	TraversalCounts rayShare = threadTraversalCounts.getShare(packet.rayNum);
+#endif
+	// Rays were added in rows, so are read back in the same order
+	int ray = 0;
+	for (int y = startY; y < endY; y += stride) {
+		for (int x = startX; x < endX; x += stride) {
+			if (isTracedInPass(x, y, stride, isFirstPass)) {
+				RESET_TRAVERSAL_COUNTS();
+				Vec3 colour = getHitColour(packet.getDirection(ray), packet.t[ray], packet.instanceIndices[ray], packet.triangleIndices[ray]);
+				framebuffer.fillBlock(x, y, stride, colour);
+				setDepth(framebuffer, x, y, stride, packet.t[ray]);
+#if TRAVERSAL_STATS
+				traversalStats.fillBlock(x, y, stride, threadTraversalCounts += rayShare);
+#endif
+				ray++;
+			}
+		}
+	}
 }
 
 Ray Camera::emitScreenRay(int pixelX, int pixelY) {
+	Vec3 rayDirection = getViewDirection(pixelX, pixelY);
+	// Rotate the ray from view space, where the camera looks along the z-axis, into world space
+	if (isRotated) rayDirection = orientation * rayDirection;
+	// The view direction is already normalised, and rotating it keeps it that way
+	return Ray(position, rayDirection, AlreadyNormalised());
+}
+
+Vec3 Camera::getViewDirection(int pixelX, int pixelY) const {
 	// Get the coordinates of the ray in view-space coordinates
 	float screenX = (pixelX - halfPixelWidth) / (float)halfPixelWidth;
 	float screenY = (pixelY - halfPixelHeight) / (float)halfPixelHeight;
 	// The coordinates are distributed in a square, so scale the x-coordinate
 	// by the aspect ratio to get the correct proportions in world-space
 	screenX *= aspectRatio;
-	// Find the normalised ray direction in world space
-	Vec3 rayDirection = Vec3(screenX, screenY, distToProjPlane).normalise();
-	return Ray(position, rayDirection);
+	// Find the normalised ray direction in view space
+	return Vec3(screenX, screenY, distToProjPlane).normalise();
 }
 
-Vec3 Camera::getRayIntersectionColour(Ray& ray) {
+Vec3 Camera::getRayIntersectionColour(Ray& ray, float& t) {
 	Vec3 intersection = Vec3();
 	// Indices are initialised to '-1' to detect if no collision occurs
-	int modelIndex = -1;
+	int instanceIndex = -1;
 	int triangleIndex = -1;
-	// Get the index of the triangle (and it's parent model)
+	// Get the index of the triangle (and the instance of its model)
 	// that the ray has it's closest intersection with
-	getCollisionIndices(ray, modelIndex, triangleIndex);
+	getCollisionIndices(ray, t, instanceIndex, triangleIndex);
+	return getHitColour(ray.getDirection(), t, instanceIndex, triangleIndex);
+}
+
+Vec3 Camera::getHitColour(const Vec3& rayDirection, float t, int instanceIndex, int triangleIndex) {
 	// Initially set the pixel colour to the background colour
-	Vec3 colour = Vec3(0.02, 0.02, 0.04);
+	Vec3 colour = BACKGROUND_COLOUR;
 
-	if (modelIndex != -1 && triangleIndex != -1) {
-		// Find the brightness of the point on the triangle
-		float brightness = getBrightnessAtPoint(modelIndex, triangleIndex);
-		colour = models[modelIndex]->colour * brightness;
+	if (instanceIndex != -1 && triangleIndex != -1) {
+		const Instance& instance = scene->getInstance(instanceIndex);
+		if (scene->getLightNum() > 0) {
+			colour = instance.colour * getLightAtPoint(position + rayDirection * t, rayDirection, t, instanceIndex, triangleIndex);
+		}
+		else {
+			// Find the brightness of the point on the triangle
+			float brightness = getBrightnessAtPoint(instanceIndex, triangleIndex);
+			colour = instance.colour * brightness;
+		}
 	}
 	return colour;
 }
 
-void Camera::getCollisionIndices(Ray& ray, int& modelIndex, int& triangleIndex) {
-	float t = (float)MAX_DIST;
-	float closest = t * 2;
-	int tempTriangleIndex = -1;
-	// Iterate over models, checking for collisions
-	// If there is a successful intersection and it's the closest one yet, set all the out variables
-	for (int i = 0; i < lastModelIndex; i++) {
-		bool isIntersection = models[i]->rayIntersection(ray, t, tempTriangleIndex);
-		if (isIntersection && t < closest) {
-			modelIndex = i;
-			triangleIndex = tempTriangleIndex;
-			closest = t;
-		}
-	}
+void Camera::getCollisionIndices(Ray& ray, float& t, int& instanceIndex, int& triangleIndex) {
+	// The scene finds the closest intersection across all the instances in one traversal
+	t = (float)MAX_DIST;
+	scene->rayIntersection(ray, t, instanceIndex, triangleIndex);
 }
 
-float Camera::getBrightnessAtPoint(int& modelIndex, int& triangleIndex) {
+float Camera::getBrightnessAtPoint(int& instanceIndex, int& triangleIndex) {
 	// Get the normal vector to the triangle, and use it to calculate the brightness at that point
-	Triangle triangle = models[modelIndex]->getTriangle(triangleIndex);
+	const Instance& instance = scene->getInstance(instanceIndex);
+	Triangle triangle = instance.getModel().getTriangle(triangleIndex);
 	int normalIndex = triangle.getNormalIndex();
-	Ray normalRay = Ray(
-		models[modelIndex]->getPosition(),
-		models[modelIndex]->getNormal(normalIndex));
-	return getBrightnessAtNormal(normalRay);
+	return getBrightnessAtNormal(instance.getNormal(normalIndex).normalise());
 }
 
-float Camera::getBrightnessAtNormal(Ray& normalRay) {
+float Camera::getBrightnessAtNormal(const Vec3& normal) {
 	// Get brightness by angle towards positive x-axis
 	// Brightness is in the range [0, 1] so raising
 	// to a power of 3 creates sharper highlights
-	float brightness = (normalRay.getDirection().dot(Vec3(1.0, 0.0, 0.0)) / 2.0) + 0.5;
+	float brightness = (normal.dot(Vec3(1.0, 0.0, 0.0)) / 2.0) + 0.5;
 	return pow(brightness, 3.0);
 }
 
-void Camera::setDrawColour(SDL_Renderer* renderer, Vec3& colour) {
-	// Tone-map the colour, and convert each component to an 8 bit integer
-	SDL_SetRenderDrawColor(
-		renderer,
-		(Uint8)(toneMap(colour.x) * 256),
-		(Uint8)(toneMap(colour.y) * 256),
-		(Uint8)(toneMap(colour.z) * 256),
-		(Uint8)255);
+Vec3 Camera::getLightAtPoint(const Vec3& point, const Vec3& rayDirection, float t, int instanceIndex, int triangleIndex) {
+	const Instance& instance = scene->getInstance(instanceIndex);
+	Vec3 normal = instance.getNormal(instance.getModel().getTriangle(triangleIndex).getNormalIndex());
+	// Light the side of the surface the ray arrived on, whichever way the model's normal faces
+	if (normal.dot(rayDirection) > 0.0f) normal = normal.getReverse();
+	Vec3 shadowOrigin = point + normal * (SHADOW_BIAS * std::max(1.0f, t));
+	Vec3 light = AMBIENT_LIGHT;
+	for (int i = 0; i < scene->getLightNum(); i++) {
+		const Light& sceneLight = scene->getLight(i);
+		Vec3 toLight, strength;
+		float distance;
+		if (sceneLight.type == LightTypes::point) {
+			Vec3 offset = sceneLight.vector - point;
+			distance = offset.getLength();
+			if (distance <= 0.0f) continue;
+			toLight = offset / distance;
+			strength = sceneLight.colour / (distance * distance);
+		}
+		else {
+			toLight = sceneLight.vector.normalise().getReverse();
+			strength = sceneLight.colour;
+			distance = (float)MAX_DIST;
+		}
+		// Surfaces facing away from a light can't be lit by it, so need no shadow ray
+		float cosine = normal.dot(toLight);
+		if (cosine <= 0.0f) continue;
+		// Shadow rays only need to know if anything is in the way, not what is closest
+		if (scene->isOccluded(Ray(shadowOrigin, toLight, AlreadyNormalised()), distance)) continue;
+		light = light + strength * cosine;
+	}
+	return light;
 }
 
-float Camera::toneMap(float value) {
-	// Tone-map HDR (high dynamic range) colours to LDR (low dynamic range)
-	// colours that can be represented on a screen
-	float mapped = value / (value + 1);
-	return pow(mapped, 1 / 2.2); // Gamma value
+void Camera::insertModel(std::shared_ptr<Model> model) {
+	scene->insertInstance(Instance(model));
 }
 
-void Camera::insertModel(std::shared_ptr<Model> model) {
-	models.push_back(model);
-	lastModelIndex += 1;
-}
\ No newline at end of file
+void Camera::insertInstance(const Instance& instance) {
+	scene->insertInstance(instance);
+}
+
+void Camera::insertLight(const Light& light) {
+	scene->insertLight(light);
+}
+
+void Camera::setInstancePlacement(int index, Vec3 instancePosition, Mat3 rotation) {
+	scene->setInstancePlacement(index, instancePosition, rotation);
+}
+
+void Camera::updateInstanceBounds() {
+	scene->updateInstanceBounds();
+}
+
+void Camera::setScene(std::shared_ptr<Scene> _scene) {
+	scene = _scene;
+}
+
+std::shared_ptr<Scene> Camera::getScene() const {
+	return scene;
+}
+
+void Camera::setThreadPool(std::shared_ptr<ThreadPool> _threadPool) {
+	threadPool = _threadPool;
+}
+
+std::shared_ptr<ThreadPool> Camera::getThreadPool() const {
+	return threadPool;
+}
+
+void Camera::setPacketSize(int _packetSize) {
+	packetSize = _packetSize;
+}
+
+void Camera::setPrintsProgress(bool _printsProgress) {
+	printsProgress = _printsProgress;
+}
+
+Vec3 Camera::getPosition() const {
+	return position;
+}
+
+void Camera::setPosition(const Vec3& _position) {
+	position = _position;
+}
+
+void Camera::move(const Vec3& offset) {
+	// Offsets are in view space, so rotate them with the camera
+	position = position + orientation * offset;
+}
+
+void Camera::rotate(float yawChange, float pitchChange) {
+	setRotation(yaw + yawChange, pitch + pitchChange);
+}
+
+void Camera::setRotation(float _yaw, float _pitch) {
+	yaw = fmod(_yaw, 360.0f);
+	pitch = std::max(-MAX_PITCH, std::min(_pitch, MAX_PITCH));
+	// Pitch tilts the view about the x-axis, with positive angles looking up towards -y (the top of
+	// the screen), and yaw then turns it about the y-axis, with positive angles turning towards +x
+	float cy = cos(yaw * DEG2RAD);
+	float sy = sin(yaw * DEG2RAD);
+	float cp = cos(pitch * DEG2RAD);
+	float sp = sin(pitch * DEG2RAD);
+	Mat3 yawMat = Mat3(
+		cy, 0.0f, sy,
+		0.0f, 1.0f, 0.0f,
+		-sy, 0.0f, cy);
+	Mat3 pitchMat = Mat3(
+		1.0f, 0.0f, 0.0f,
+		0.0f, cp, -sp,
+		0.0f, sp, cp);
+	orientation = yawMat * pitchMat;
+	// The unrotated camera skips rotating each ray, so that its renders are unchanged
+	isRotated = yaw != 0.0f || pitch != 0.0f;
+}
+
+float Camera::getYaw() const {
+	return yaw;
+}
+
+float Camera::getPitch() const {
+	return pitch;
+}
+
+bool Camera::reproject(const Framebuffer& previous, Framebuffer& reprojected) const {
+	int width = previous.getWidth();
+	int height = previous.getHeight();
+	if (depths.size() != width * height) return false;
+	reprojected = Framebuffer(width, height);
+	// Distance from the camera to what each pixel shows, so that nearer surfaces cover further ones
+	std::vector<float> nearest(width * height, (float)MAX_DIST);
+	Mat3 toView = orientation.getTranspose();
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			reprojected.setPixel(x, y, BACKGROUND_COLOUR);
+		}
+	}
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			float t = depths[y * width + x];
+			if (t >= (float)MAX_DIST) continue;
+			// Find the point the pixel showed, and where it is on the screen now
+			Vec3 point = depthPosition + depthOrientation * getViewDirection(x, y) * t;
+			Vec3 viewPoint = toView * (point - position);
+			if (viewPoint.z <= 0.0f) continue;
+			float screenX = viewPoint.x / viewPoint.z * distToProjPlane / aspectRatio;
+			float screenY = viewPoint.y / viewPoint.z * distToProjPlane;
+			int pixelX = (int)floor(screenX * halfPixelWidth + halfPixelWidth + 0.5f);
+			int pixelY = (int)floor(screenY * halfPixelHeight + halfPixelHeight + 0.5f);
+			float distance = viewPoint.getLength();
+			// Points are splatted over 2x2 pixels, which covers most of the gaps left as surfaces come closer
+			for (int splatY = pixelY; splatY < pixelY + 2; splatY++) {
+				for (int splatX = pixelX; splatX < pixelX + 2; splatX++) {
+					if (splatX < 0 || splatY < 0 || splatX >= width || splatY >= height) continue;
+					int index = splatY * width + splatX;
+					if (distance >= nearest[index]) continue;
+					nearest[index] = distance;
+					reprojected.setPixel(splatX, splatY, previous.getPixel(x, y));
+				}
+			}
+		}
+	}
+	return true;
+}
+
+#if TRAVERSAL_STATS
+const TraversalStats& Camera::getTraversalStats() const {
+	return traversalStats;
+}
+#endif
@@ -1,31 +1,107 @@
 #pragma once
 
 #include <vector>
-#include <SDL.h>
-#include "model.h"
+#include <functional>
+#include "scene.h"
+#include "framebuffer.h"
+#include "threadpool.h"
+#include "traversalstats.h"
 
 struct Camera {
 private:
 	Vec3 position;
+	// Direction the camera faces, in degrees, and the rotation from view space into world space they make
+	float yaw = 0.0f, pitch = 0.0f;
+	Mat3 orientation;
+	bool isRotated = false;
 	float aspectRatio;
 	int pixelWidth, pixelHeight, halfPixelWidth, halfPixelHeight;
 	float distToProjPlane;
 
-	int lastModelIndex = 0;
-	std::vector<std::shared_ptr<Model>> models;
+	std::shared_ptr<Scene> scene;
+	std::shared_ptr<ThreadPool> threadPool;
+	// Width and height in pixels of the blocks traced together as ray packets, or zero to trace single rays
+	int packetSize = 0;
+	bool printsProgress = true;
+	// Distance to whatever each pixel of the last render shows, and where it was rendered from, so
+	// that the render can be reprojected to where the camera has moved to since
+	std::vector<float> depths;
+	Vec3 depthPosition;
+	Mat3 depthOrientation;
+#if TRAVERSAL_STATS
+	// Work done tracing each pixel of the last render, including its shadow rays
+	TraversalStats traversalStats;
+#endif
 
-	void renderPixel(SDL_Renderer* renderer, int pixelX, int pixelY);
-	Ray emitScreenRay(int pixelX, int pixelY);
-	Vec3 getRayIntersectionColour(Ray& ray);
-	void getCollisionIndices(Ray& ray, int& modelIndex, int& triangleIndex);
-	float getBrightnessAtPoint(int& modelIndex, int& triangleIndex);
-	float getBrightnessAtNormal(Ray& normalRay);
+	void beginFrame(const Framebuffer& framebuffer);
+	void setDepth(const Framebuffer& framebuffer, int x, int y, int size, float t);
 
-	void setDrawColour(SDL_Renderer* renderer, Vec3& colour);
-	float toneMap(float value);
+	void renderImageSerial(Framebuffer& framebuffer);
+	void renderImageParallel(Framebuffer& framebuffer);
+	int getPassTileNum(const Framebuffer& framebuffer, int stride) const;
+	// Trace one ray for every 'stride' pixels in x and y, skipping those traced by the pass before
+	// unless this is the first, and fill the block of pixels each ray stands for with its colour
+	void renderPass(Framebuffer& framebuffer, int stride, bool isFirstPass);
+	void renderTile(Framebuffer& framebuffer, int tileIndex, int stride, bool isFirstPass);
+	Vec3 tracePixel(int pixelX, int pixelY, float& t);
+	void tracePacket(Framebuffer& framebuffer, int startX, int startY, int stride = 1, bool isFirstPass = true);
+	Ray emitScreenRay(int pixelX, int pixelY);
+	Vec3 getViewDirection(int pixelX, int pixelY) const;
+	Vec3 getRayIntersectionColour(Ray& ray, float& t);
+	// Colour of whatever a ray from the camera hit at distance 't', or the background if it hit nothing
+	Vec3 getHitColour(const Vec3& rayDirection, float t, int instanceIndex, int triangleIndex);
+	void getCollisionIndices(Ray& ray, float& t, int& instanceIndex, int& triangleIndex);
+	float getBrightnessAtPoint(int& instanceIndex, int& triangleIndex);
+	float getBrightnessAtNormal(const Vec3& normal);
+	// Light reaching a point on a triangle from each of the scene's lights that isn't blocked
+	Vec3 getLightAtPoint(const Vec3& point, const Vec3& rayDirection, float t, int instanceIndex, int triangleIndex);
 public:
+	// Number of passes in a full-quality progressive render, the first of which traces one ray in every 16x16 pixels
+	static constexpr int maxQuality = 5;
+	// Called after each pass of a progressive render, counted from zero, with the pixels between the
+	// rays it traced. The whole framebuffer has been filled in by then, so can be displayed
+	typedef std::function<void(const Framebuffer& framebuffer, int pass, int stride)> PassCallback;
+
 	Camera(Vec3 _position, int _pixelWidth, int _pixelHeight, float _horizontalFOV = 90.0f);
 
-	void renderImage(SDL_Renderer* renderer, int screenWidth, int screenHeight);
-	void insertModel(std::shared_ptr<Model> object);
+	void renderImage(Framebuffer& framebuffer);
+	// Render in passes from coarse to fine, each tracing rays twice as close together as the one
+	// before. 'quality' is the number of passes, so below 'maxQuality' the render stops early with
+	// a coarser image. At full quality, every pixel is traced once, as by 'renderImage'
+	void renderProgressive(Framebuffer& framebuffer, int quality = maxQuality, const PassCallback& onPass = PassCallback());
+	// Place a model in the scene as it is, or as an instance shared with other placements of it
+	void insertModel(std::shared_ptr<Model> model);
+	void insertInstance(const Instance& instance);
+	// Light the scene, casting shadows. Scenes without lights are shaded by a fixed light along the x-axis, without shadows
+	void insertLight(const Light& light);
+	// Move an instance, counted in the order inserted, between frames of an animation
+	void setInstancePlacement(int index, Vec3 instancePosition, Mat3 rotation);
+	// Update the scene after the vertices of any of its models have been moved
+	void updateInstanceBounds();
+	// Share a scene, and the models loaded into it, with other cameras
+	void setScene(std::shared_ptr<Scene> _scene);
+	std::shared_ptr<Scene> getScene() const;
+	void setThreadPool(std::shared_ptr<ThreadPool> _threadPool);
+	std::shared_ptr<ThreadPool> getThreadPool() const;
+	// Trace square blocks of 2x2 or 8x8 pixels as packets of rays, or single rays if zero
+	void setPacketSize(int _packetSize);
+	// Whether renders print their progress to the console
+	void setPrintsProgress(bool _printsProgress);
+
+	Vec3 getPosition() const;
+	void setPosition(const Vec3& _position);
+	// Move by an offset in view space, where +z is forwards, +x is right and -y is up the screen
+	void move(const Vec3& offset);
+	// Turn by angles in degrees. Positive yaw turns right, and positive pitch looks up
+	void rotate(float yawChange, float pitchChange);
+	void setRotation(float _yaw, float _pitch);
+	float getYaw() const;
+	float getPitch() const;
+	// Approximate the view from where the camera is now by moving each pixel of the last frame rendered,
+	// 'previous', to where it now appears, before a new frame is traced. Parts of the scene that were
+	// hidden or off screen are left as background. Returns false if there is no last frame to reproject
+	bool reproject(const Framebuffer& previous, Framebuffer& reprojected) const;
+#if TRAVERSAL_STATS
+	const TraversalStats& getTraversalStats() const;
+#endif
 };
\ No newline at end of file
@@ -0,0 +1,71 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <algorithm>
+#include "framebuffer.h"
+#include "postprocess.h"
+
+Framebuffer::Framebuffer(int _width, int _height)
+	: width(_width), height(_height), pixels(_width * _height) {
+}
+
+int Framebuffer::getWidth() const {
+	return width;
+}
+
+int Framebuffer::getHeight() const {
+	return height;
+}
+
+Vec3 Framebuffer::getPixel(int x, int y) const {
+	return pixels[y * width + x];
+}
+
+void Framebuffer::setPixel(int x, int y, const Vec3& colour) {
+	pixels[y * width + x] = colour;
+}
+
+const Vec3* Framebuffer::getRow(int y) const {
+	return &pixels[y * width];
+}
+
+void Framebuffer::fillBlock(int x, int y, int size, const Vec3& colour) {
+	int endX = std::min(x + size, width);
+	int endY = std::min(y + size, height);
+	for (int blockY = y; blockY < endY; blockY++) {
+		for (int blockX = x; blockX < endX; blockX++) {
+			pixels[blockY * width + blockX] = colour;
+		}
+	}
+}
+
+void Framebuffer::toRGB24(std::vector<uint8_t>& out) const {
+	// The default settings' gamma table is only built once
+	static const PostProcess defaultPostProcess;
+	defaultPostProcess.apply(*this, out);
+}
+
+void Framebuffer::toRGB24(std::vector<uint8_t>& out, const PostProcess& postProcess, ThreadPool* threadPool) const {
+	postProcess.apply(*this, out, threadPool);
+}
+
+bool Framebuffer::writePPM(const std::string& path) const {
+	static const PostProcess defaultPostProcess;
+	return writePPM(path, defaultPostProcess);
+}
+
+bool Framebuffer::writePPM(const std::string& path, const PostProcess& postProcess, ThreadPool* threadPool) const {
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file == nullptr) {
+		printf("Impossible to open output image file!\n");
+		printf("%s\n", path.c_str());
+		return false;
+	}
+	std::vector<uint8_t> rgb;
+	postProcess.apply(*this, rgb, threadPool);
+	// Binary PPM: a short text header followed by the raw RGB bytes
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	size_t written = fwrite(rgb.data(), 1, rgb.size(), file);
+	fclose(file);
+	return written == rgb.size();
+}
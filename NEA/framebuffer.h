@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include "geometry.h"
+
+struct PostProcess;
+struct ThreadPool;
+
+// Contiguous buffer of linear (HDR) pixel colours, stored in rows from the top-left of the image
+struct Framebuffer {
+private:
+	int width, height;
+	std::vector<Vec3> pixels;
+public:
+	Framebuffer(int _width = 0, int _height = 0);
+
+	int getWidth() const;
+	int getHeight() const;
+	Vec3 getPixel(int x, int y) const;
+	void setPixel(int x, int y, const Vec3& colour);
+	// Pixels of a row, from left to right
+	const Vec3* getRow(int y) const;
+	// Set a square block of pixels from its top-left corner, cut short at the edges of the image
+	void fillBlock(int x, int y, int size, const Vec3& colour);
+	// Tone map every pixel into tightly packed 8-bit RGB triples, with the default post-processing
+	// settings unless others are given, on the thread pool if one is given
+	void toRGB24(std::vector<uint8_t>& out) const;
+	void toRGB24(std::vector<uint8_t>& out, const PostProcess& postProcess, ThreadPool* threadPool = nullptr) const;
+	bool writePPM(const std::string& path) const;
+	bool writePPM(const std::string& path, const PostProcess& postProcess, ThreadPool* threadPool = nullptr) const;
+};
@@ -1,50 +1,303 @@
 #pragma once
 
+#include <math.h>
+#include <algorithm>
+
+// Every operation is defined inline in this header, so that the intersection code using them
+// compiles down to plain floating point arithmetic, with no calls or copies in between. Those
+// that don't need a square root are constexpr, so constant vectors and matrices cost nothing
+
 struct Vec3 {
 	float x, y, z;
 
-	Vec3(float _x = 0.0f, float _y = 0.0f, float _z = 0.0f);
-	Vec3(const Vec3& other);
-	float dot(const Vec3& other) const;
-	Vec3 cross(const Vec3& other) const;
-	Vec3 operator+(const Vec3& other) const;
-	Vec3 operator-(const Vec3& other) const;
-	Vec3 operator*(const float other) const;
-	Vec3 operator*(const Vec3& other) const;
-	Vec3 operator/(const float other) const;
+	constexpr Vec3(float _x = 0.0f, float _y = 0.0f, float _z = 0.0f);
+	constexpr float dot(const Vec3& other) const;
+	constexpr Vec3 cross(const Vec3& other) const;
+	constexpr Vec3 operator+(const Vec3& other) const;
+	constexpr Vec3 operator-(const Vec3& other) const;
+	constexpr Vec3 operator*(const float other) const;
+	constexpr Vec3 operator*(const Vec3& other) const;
+	constexpr Vec3 operator/(const float other) const;
 	float getLength() const;
 	Vec3 normalise() const;
-	Vec3 getReverse() const;
+	constexpr Vec3 getReverse() const;
+};
+
+struct AABB {
+	Vec3 min, max;
+
+	// Coordinate beyond any in a scene, which empty boxes have their corners at
+	static constexpr float infinity = 1e30f;
+
+	// Default constructor creates an empty (inverted) box, which any point will grow
+	constexpr AABB();
+	constexpr AABB(const Vec3& _min, const Vec3& _max);
+
+	void grow(const Vec3& point);
+	void grow(const AABB& other);
+	constexpr Vec3 getCenter() const;
+	constexpr Vec3 getExtent() const;
+	constexpr float getSurfaceArea() const;
+	constexpr bool isEmpty() const;
+	// Slab test against a ray given by its origin and reciprocal direction. Boxes entered
+	// at or beyond 't' count as missed. 'tEntry' is set to where the ray enters the box
+	bool rayIntersection(const Vec3& origin, const Vec3& invDirection, float t, float& tEntry) const;
 };
 
 struct Mat3 {
 	float x0, y0, z0, x1, y1, z1, x2, y2, z2;
 
-	Mat3(
+	constexpr Mat3(
 		float _x0 = 1.0f, float _y0 = 0.0f, float _z0 = 0.0f,
 		float _x1 = 0.0f, float _y1 = 1.0f, float _z1 = 0.0f,
 		float _x2 = 0.0f, float _y2 = 0.0f, float _z2 = 1.0f);
-	Mat3(const Mat3& other);
 
-	Mat3 getSquare() const;
-	Mat3 operator+(const Mat3& other) const;
-	Mat3 operator*(const float other) const;
-	Vec3 operator*(const Vec3& other) const;
-	Mat3 operator*(const Mat3& other) const;
+	constexpr Mat3 getSquare() const;
+	// Get the matrix with its rows and columns swapped, which inverts a rotation or reflection
+	constexpr Mat3 getTranspose() const;
+	constexpr Mat3 operator+(const Mat3& other) const;
+	constexpr Mat3 operator*(const float other) const;
+	constexpr Vec3 operator*(const Vec3& other) const;
+	constexpr Mat3 operator*(const Mat3& other) const;
 };
 
+// Passed to Ray's constructor to take a direction that is already of length one as it is, rather
+// than normalising it again, which would cost a square root and three divisions for nothing
+struct AlreadyNormalised {};
+
 struct Ray {
 private:
 	Vec3 origin;
 	Vec3 direction;
+	// Reciprocal of each direction component, precomputed for slab tests against bounding boxes
+	Vec3 invDirection;
+
+	void updateInvDirection();
 public:
 	Ray(Vec3 _origin = Vec3(), Vec3 _direction = Vec3(1.0f, 0.0f, 0.0f));
-	Ray(const Ray& other);
+	Ray(const Vec3& _origin, const Vec3& _direction, AlreadyNormalised);
 
 	Vec3 getOrigin() const;
 	Vec3 getDirection() const;
+	Vec3 getInvDirection() const;
 	void setOrigin(const Vec3& _origin);
 	void setDirection(const Vec3& _direction);
 	void normalise();
 	Vec3 project(const float t) const;
 };
+
+// ------------------------------------ //
+//               Vector 3               //
+// ------------------------------------ //
+
+// Default constructor
+constexpr Vec3::Vec3(float _x, float _y, float _z)
+	: x(_x), y(_y), z(_z) {
+}
+// Dot product
+constexpr float Vec3::dot(const Vec3& other) const {
+	return x * other.x + y * other.y + z * other.z;
+}
+// Cross product
+constexpr Vec3 Vec3::cross(const Vec3& other) const {
+	return Vec3(
+		y * other.z - z * other.y,
+		z * other.x - x * other.z,
+		x * other.y - y * other.x);
+}
+// Addition operator
+constexpr Vec3 Vec3::operator+(const Vec3& other) const {
+	return Vec3(x + other.x, y + other.y, z + other.z);
+}
+// Subtraction operator
+constexpr Vec3 Vec3::operator-(const Vec3& other) const {
+	return Vec3(x - other.x, y - other.y, z - other.z);
+}
+// Vector-scalar multiplication operator
+constexpr Vec3 Vec3::operator*(const float other) const {
+	return Vec3(x * other, y * other, z * other);
+}
+// Component-wise vector-vector multiplication operator
+constexpr Vec3 Vec3::operator*(const Vec3& other) const {
+	return Vec3(x * other.x, y * other.y, z * other.z);
+}
+// Vector-scalar division operator
+constexpr Vec3 Vec3::operator/(const float other) const {
+	return Vec3(x / other, y / other, z / other);
+}
+// Get the magnitude of the vector
+inline float Vec3::getLength() const {
+	return sqrt(x * x + y * y + z * z);
+}
+// Return a normalised version of the vector (i.e of magnitude 1)
+inline Vec3 Vec3::normalise() const {
+	float length = getLength();
+	return Vec3(x / length, y / length, z / length);
+}
+// Get the vector in the opposite direction with the same magnitude
+constexpr Vec3 Vec3::getReverse() const {
+	return Vec3(-x, -y, -z);
+}
+
+// -------------------------------------------------- //
+//               Axis-Aligned Bounding Box              //
+// -------------------------------------------------- //
+
+// Default constructor
+constexpr AABB::AABB()
+	: min(infinity, infinity, infinity), max(-infinity, -infinity, -infinity) {
+}
+// Constructor from corners
+constexpr AABB::AABB(const Vec3& _min, const Vec3& _max)
+	: min(_min), max(_max) {
+}
+// Expand the box to contain a point
+inline void AABB::grow(const Vec3& point) {
+	min = Vec3(std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z));
+	max = Vec3(std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z));
+}
+// Expand the box to contain another box
+inline void AABB::grow(const AABB& other) {
+	min = Vec3(std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z));
+	max = Vec3(std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z));
+}
+// Get the point in the middle of the box
+constexpr Vec3 AABB::getCenter() const {
+	return (min + max) * 0.5f;
+}
+// Get the size of the box along each axis
+constexpr Vec3 AABB::getExtent() const {
+	return max - min;
+}
+// Get the total area of the six faces of the box (zero for an empty box)
+constexpr float AABB::getSurfaceArea() const {
+	if (isEmpty()) return 0.0f;
+	Vec3 extent = getExtent();
+	return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+// Check if the box contains no points
+constexpr bool AABB::isEmpty() const {
+	return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+// Slab test: the ray is inside the box where the distances between each axis' pair of bounding planes all overlap
+inline bool AABB::rayIntersection(const Vec3& origin, const Vec3& invDirection, float t, float& tEntry) const {
+	const Vec3 t0 = (min - origin) * invDirection;
+	const Vec3 t1 = (max - origin) * invDirection;
+	const float tNear = std::max(std::max(std::min(t0.x, t1.x), std::min(t0.y, t1.y)), std::min(t0.z, t1.z));
+	const float tFar = std::min(std::min(std::max(t0.x, t1.x), std::max(t0.y, t1.y)), std::max(t0.z, t1.z));
+	tEntry = tNear;
+	// Boxes entirely behind the ray, or beyond the closest hit found so far, are missed
+	return tNear <= tFar && tFar >= 0.0f && tNear < t;
+}
+
+// -------------------------------------- //
+//               Matrix 3x3               //
+// -------------------------------------- //
+
+// Default constructor
+constexpr Mat3::Mat3(float _x0, float _y0, float _z0, float _x1, float _y1, float _z1, float _x2, float _y2, float _z2)
+	: x0(_x0), y0(_y0), z0(_z0), x1(_x1), y1(_y1), z1(_z1), x2(_x2), y2(_y2), z2(_z2) {
+}
+// Get the matrix multiplied by itself
+constexpr Mat3 Mat3::getSquare() const {
+	return Mat3(
+		x0 * x0 + y0 * x1 + z0 * x2,
+		x0 * y0 + y0 * y1 + z0 * y2,
+		x0 * z0 + y0 * z1 + z0 * z2,
+		x1 * x0 + y1 * x1 + z1 * x2,
+		x1 * y0 + y1 * y1 + z1 * y2,
+		x1 * z0 + y1 * z1 + z1 * z2,
+		x2 * x0 + y2 * x1 + z2 * x2,
+		x2 * y0 + y2 * y1 + z2 * y2,
+		x2 * z0 + y2 * z1 + z2 * z2);
+}
+// Get the matrix with its rows and columns swapped
+constexpr Mat3 Mat3::getTranspose() const {
+	return Mat3(
+		x0, x1, x2,
+		y0, y1, y2,
+		z0, z1, z2);
+}
+// Addition operator
+constexpr Mat3 Mat3::operator+(const Mat3& other) const {
+	return Mat3(
+		x0 + other.x0, y0 + other.y0, z0 + other.z0,
+		x1 + other.x1, y1 + other.y1, z1 + other.z1,
+		x2 + other.x2, y2 + other.y2, z2 + other.z2);
+}
+// Matrix-scalar multiplication operator
+constexpr Mat3 Mat3::operator*(const float other) const {
+	return Mat3(
+		x0 * other, y0 * other, z0 * other,
+		x1 * other, y1 * other, z1 * other,
+		x2 * other, y2 * other, z2 * other);
+}
+// Matrix-vector multiplication operator
+constexpr Vec3 Mat3::operator*(const Vec3& other) const {
+	return Vec3(
+		other.x * x0 + other.y * y0 + other.z * z0,
+		other.x * x1 + other.y * y1 + other.z * z1,
+		other.x * x2 + other.y * y2 + other.z * z2);
+}
+// Matrix-matrix multiplication operator
+constexpr Mat3 Mat3::operator*(const Mat3& other) const {
+	return Mat3(
+		x0 * other.x0 + y0 * other.x1 + z0 * other.x2,
+		x0 * other.y0 + y0 * other.y1 + z0 * other.y2,
+		x0 * other.z0 + y0 * other.z1 + z0 * other.z2,
+		x1 * other.x0 + y1 * other.x1 + z1 * other.x2,
+		x1 * other.y0 + y1 * other.y1 + z1 * other.y2,
+		x1 * other.z0 + y1 * other.z1 + z1 * other.z2,
+		x2 * other.x0 + y2 * other.x1 + z2 * other.x2,
+		x2 * other.y0 + y2 * other.y1 + z2 * other.y2,
+		x2 * other.z0 + y2 * other.z1 + z2 * other.z2);
+}
+
+// ------------------------------- //
+//               Ray               //
+// ------------------------------- //
+
+// Default constructor
+inline Ray::Ray(Vec3 _origin, Vec3 _direction)
+	: origin(_origin), direction(_direction.normalise()) {
+	updateInvDirection();
+}
+// Constructor from a direction that is already normalised
+inline Ray::Ray(const Vec3& _origin, const Vec3& _direction, AlreadyNormalised)
+	: origin(_origin), direction(_direction) {
+	updateInvDirection();
+}
+// Recalculate the reciprocal direction after the direction changes
+inline void Ray::updateInvDirection() {
+	invDirection = Vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+}
+// Get the origin of the ray
+inline Vec3 Ray::getOrigin() const {
+	return origin;
+}
+// Get the direction of the ray
+inline Vec3 Ray::getDirection() const {
+	return direction;
+}
+// Get the reciprocal of each component of the direction
+inline Vec3 Ray::getInvDirection() const {
+	return invDirection;
+}
+// Set the origin of the ray
+inline void Ray::setOrigin(const Vec3& _origin) {
+	origin = _origin;
+}
+// Set the direction of the ray
+inline void Ray::setDirection(const Vec3& _direction) {
+	direction = _direction;
+	updateInvDirection();
+}
+// Normalise the direction of the ray
+inline void Ray::normalise() {
+	direction = direction.normalise();
+	updateInvDirection();
+}
+// Get the point at distance 't' from the origin along the direction vector
+inline Vec3 Ray::project(const float t) const {
+	return origin + direction * t;
+}
@@ -0,0 +1,100 @@
+#include "instance.h"
+
+Instance::Instance(std::shared_ptr<const Model> _model, Vec3 _position, Mat3 rotation)
+	: model(_model), colour(_model->colour) {
+	setPlacement(_position, rotation);
+}
+
+void Instance::setPlacement(Vec3 _position, Mat3 rotation) {
+	position = _position;
+	toScene = rotation;
+	toModel = rotation.getTranspose();
+	const Mat3 identity;
+	isRotated =
+		rotation.x0 != identity.x0 || rotation.y0 != identity.y0 || rotation.z0 != identity.z0 ||
+		rotation.x1 != identity.x1 || rotation.y1 != identity.y1 || rotation.z1 != identity.z1 ||
+		rotation.x2 != identity.x2 || rotation.y2 != identity.y2 || rotation.z2 != identity.z2;
+	updateBounds();
+}
+
+void Instance::updateBounds() {
+	// The rotated box around the model's box is looser than one fitted to its vertices, but is only
+	// used to place the instance in the top-level hierarchy
+	bounds = AABB();
+	AABB modelBounds = model->getBounds();
+	if (modelBounds.isEmpty()) return;
+	for (int corner = 0; corner < 8; corner++) {
+		Vec3 point = Vec3(
+			corner & 1 ? modelBounds.max.x : modelBounds.min.x,
+			corner & 2 ? modelBounds.max.y : modelBounds.min.y,
+			corner & 4 ? modelBounds.max.z : modelBounds.min.z);
+		bounds.grow(toScene * point + position);
+	}
+}
+
+Mat3 Instance::getRotation() const {
+	return toScene;
+}
+
+const Model& Instance::getModel() const {
+	return *model;
+}
+
+Vec3 Instance::getPosition() const {
+	return position;
+}
+
+AABB Instance::getBounds() const {
+	return bounds;
+}
+
+Vec3 Instance::getNormal(int index) const {
+	if (!isRotated) return model->getNormal(index);
+	return toScene * model->getNormal(index);
+}
+
+bool Instance::rayIntersection(const Ray& ray, float& t, int& triangleIndex) const {
+	Ray modelRay = ray;
+	modelRay.setOrigin(ray.getOrigin() - position);
+	if (isRotated) {
+		modelRay.setOrigin(toModel * modelRay.getOrigin());
+		modelRay.setDirection(toModel * ray.getDirection());
+	}
+	return model->rayIntersection(modelRay, t, triangleIndex);
+}
+
+bool Instance::isOccluded(const Ray& ray, float tMax) const {
+	Ray modelRay = ray;
+	modelRay.setOrigin(ray.getOrigin() - position);
+	if (isRotated) {
+		modelRay.setOrigin(toModel * modelRay.getOrigin());
+		modelRay.setDirection(toModel * ray.getDirection());
+	}
+	return model->isOccluded(modelRay, tMax);
+}
+
+uint64_t Instance::rayPacketIntersection(RayPacket& packet, uint64_t rayMask) const {
+	Vec3 origin = packet.origin;
+	if (!isRotated) {
+		// The rays share an origin, so moving it moves the whole packet
+		packet.origin = origin - position;
+		uint64_t hitMask = model->rayPacketIntersection(packet, rayMask);
+		packet.origin = origin;
+		return hitMask;
+	}
+	// Rotated instances trace a rotated copy of the packet, and copy back the hits it finds
+	RayPacket modelPacket(toModel * (origin - position));
+	for (int i = 0; i < packet.rayNum; i++) {
+		Ray ray;
+		ray.setDirection(toModel * packet.getDirection(i));
+		modelPacket.addRay(ray, packet.t[i]);
+	}
+	uint64_t hitMask = model->rayPacketIntersection(modelPacket, rayMask);
+	for (int i = 0; i < packet.rayNum; i++) {
+		if (hitMask & ((uint64_t)1 << i)) {
+			packet.t[i] = modelPacket.t[i];
+			packet.triangleIndices[i] = modelPacket.triangleIndices[i];
+		}
+	}
+	return hitMask;
+}
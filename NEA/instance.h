@@ -0,0 +1,42 @@
+#pragma once
+
+#include <memory>
+#include "model.h"
+
+// Placement of a model in the scene. Any number of instances can share one model, and so one copy
+// of its mesh and hierarchy, each with its own rotation and position. Rays are moved into the
+// model's space to be traced, rather than the model being moved into the scene
+struct Instance {
+private:
+	std::shared_ptr<const Model> model;
+	Vec3 position;
+	// Rotation from the model's space into the scene's, and back. Both are orthonormal, so
+	// distances along a ray are the same in either space
+	Mat3 toScene;
+	Mat3 toModel;
+	// Instances that are only moved skip transforming each ray's direction
+	bool isRotated;
+	AABB bounds;
+public:
+	Vec3 colour;
+
+	// 'rotation' must not include a reflection, as that would turn the model's
+	// triangles to face away from the rays that should hit them
+	Instance(std::shared_ptr<const Model> _model, Vec3 _position = Vec3(), Mat3 rotation = Mat3());
+
+	// Move the instance to a new position and rotation, under the same restriction as when constructed
+	void setPlacement(Vec3 _position, Mat3 rotation);
+	// Fit the instance's bounds to its model again, after the model's vertices have been moved
+	void updateBounds();
+
+	const Model& getModel() const;
+	Vec3 getPosition() const;
+	Mat3 getRotation() const;
+	// Bounds of the model after it has been rotated and moved into place
+	AABB getBounds() const;
+	// Normal of one of the model's triangles, rotated into the scene
+	Vec3 getNormal(int index) const;
+	bool rayIntersection(const Ray& ray, float& t, int& triangleIndex) const;
+	bool isOccluded(const Ray& ray, float tMax) const;
+	uint64_t rayPacketIntersection(RayPacket& packet, uint64_t rayMask) const;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "geometry.h"
+
+namespace LightTypes {
+	enum LightType {
+		point,      // Shines out from a position, fading with the square of the distance from it
+		directional // Shines along a direction with the same strength everywhere, like sunlight
+	};
+}
+
+// Light shining on the scene. Surfaces it can't reach, because something else is in the way, are in its shadow
+struct Light {
+	LightTypes::LightType type;
+	// Position of a point light, or the direction a directional light shines towards
+	Vec3 vector;
+	// Colour and strength together. Point lights need strengths around the square of their distance
+	// from what they light, to light it as brightly as a directional light of strength one
+	Vec3 colour;
+};
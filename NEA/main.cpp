@@ -5,26 +5,98 @@
 #include <memory>
 #include <chrono>
 #include <string>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
 #include <SDL.h>
 #include "camera.h"
+#include "modellibrary.h"
+#include "batchrenderer.h"
+#include "postprocess.h"
+#include "threadpool.h"
 
 static int NUMCOMMANDLINEARGS = 5;
+static std::string THREADSOPTION = "--threads=";
+static std::string OUTPUTOPTION = "--output=";
+static std::string BVHOPTION = "--bvh=";
+static std::string SIMDOPTION = "--simd=";
+static std::string BVHWIDTHOPTION = "--bvh-width=";
+static std::string PACKETSOPTION = "--packets=";
+static std::string CACHEOPTION = "--cache=";
+static std::string INGESTMEMORYOPTION = "--ingest-memory=";
+static std::string SCENEOPTION = "--scene=";
+static std::string PROGRESSIVEOPTION = "--progressive=";
+static std::string QUALITYOPTION = "--quality=";
+static std::string INTERACTIVEOPTION = "--interactive=";
+static std::string REPROJECTOPTION = "--reproject=";
+static std::string VIEWSOPTION = "--views=";
+static std::string EXPOSUREOPTION = "--exposure=";
+static std::string TONEMAPOPTION = "--tonemap=";
+static std::string DITHEROPTION = "--dither=";
+static std::string HEATMAPOPTION = "--heatmap=";
 
 // Screen dimensions
 static int WIDTH;
 static int HEIGHT;
 // Camera field of view in degrees
 static float camFOV;
+// Number of threads to render with, zero uses every hardware thread
+static int threadNum = 0;
+// Image file to render into without opening a window, empty to display the render instead
+static std::string outputPath;
+// Algorithm used to build each model's bounding volume hierarchy
+static BuildStrategies::BuildStrategy buildStrategy = BuildStrategies::sah;
+// Children per node each model's hierarchy is collapsed to, out of 2, 4 or 8
+static int bvhWidth = 2;
+// Width and height of the pixel blocks traced as ray packets, zero to trace single rays
+static int packetSize = 0;
+// Whether models are loaded from, and saved to, binary cache files beside their OBJ files
+static bool useModelCache = true;
+// Megabytes of memory loading a model may use before its triangles are streamed through temporary
+// files to build its hierarchy, zero to always load and build in memory
+static int ingestMemoryMB = 0;
+// Text file of models to place in the scene, as well as any given on the command line
+static std::string scenePath;
+// Whether to render in passes from coarse to fine, displaying each pass as it completes
+static bool isProgressive = false;
+// Number of progressive passes to render, with fewer stopping early at a lower resolution
+static int quality = Camera::maxQuality;
+// Whether the window's camera can be moved with the keyboard and mouse, re-rendering the scene after each move
+static bool isInteractive = false;
+// Whether each interactive frame first shows the last one moved to the new viewpoint, while it is traced
+static bool useReprojection = false;
+// Text file of camera views to render the scene from in one batch, each to its own numbered image
+static std::string viewsPath;
+// Exposure, tone curve and dithering that renders are displayed and written with
+static PostProcess postProcess;
+// Image path each render's heatmaps of traversal work are written beside, empty to write none. Needs
+// a build with TRAVERSAL_STATS defined as 1
+static std::string heatmapPath;
 
 static Vec3 camPos = Vec3(0.0, 0.0, -10);
+// Distance moved by each key press, degrees turned by each arrow key press, and degrees turned per pixel the mouse is dragged
+static constexpr float MOVE_STEP = 0.5f;
+static constexpr float TURN_STEP = 5.0f;
+static constexpr float MOUSE_SENSITIVITY = 0.25f;
+// Exposure is multiplied or divided by this for each press of '=' or '-', half a stop at a time
+static constexpr float EXPOSURE_STEP = 1.41421356f;
 // Rotations and reflections in x, y, and z axes. To be applied to every model
 static Transform transform = Transform(25.0, 45.0, 5.0, false, true, false);
 static std::string root = "C:\\Users\\Mirrorworld\\Desktop\\NEA\\OBJ files\\";
 
+// Model file to load, and where to place it. Each file is only loaded once, however many times it is placed
+struct Placement {
+	std::string filename;
+	Vec3 position;
+	// Rotation and reflection applied after the one given to every model
+	Transform transform;
+};
+
 // Class containing SDL functionality
 struct Context {
 	SDL_Window* window;
 	SDL_Renderer* renderer;
+	SDL_Texture* texture;
 	bool initFailure;
 };
 
@@ -45,6 +117,13 @@ Context initialise() {
 		context.initFailure = EXIT_FAILURE;
 		return context;
 	}
+	// Streaming texture the rendered framebuffer is uploaded into in one go
+	context.texture = SDL_CreateTexture(context.renderer, SDL_PIXELFORMAT_RGB24, SDL_TEXTUREACCESS_STREAMING, WIDTH, HEIGHT);
+	if (context.texture == NULL) {
+		std::cout << "Could not create texture. SDL error: " << SDL_GetError() << "\n";
+		context.initFailure = EXIT_FAILURE;
+		return context;
+	}
 	context.initFailure = EXIT_SUCCESS;
 	return context;
 }
@@ -56,13 +135,13 @@ void setWindowDimensions(int _width, int _height) {
 }
 
 // Check if a char array represents an integer (used to check command line arguments)
-bool isInteger(char* string) {
+bool isInteger(const char* string) {
 	if (atoi(string) == 0 && string[0] != '0') return false;
-	return EXIT_SUCCESS;
+	return true;
 }
 
 // Check if a char array represents a floating point number (used to check command line arguments)
-bool isFloat(char* string) {
+bool isFloat(const char* string) {
 	bool pointFound = false;
 	// Iterate through the characters
 	for (int i = 0; i < strlen(string); i++) {
@@ -72,17 +151,164 @@ bool isFloat(char* string) {
 		}
 		// If the character is not a digit, fail
 		else if (!isdigit(string[i])) {
-			return EXIT_FAILURE;
+			return false;
+		}
+	}
+	return true;
+}
+
+// Remove the optional '--name=value' arguments from the argument list, and apply them
+bool parseOptionalArgs(std::vector<char*>& args) {
+	std::vector<char*> remainingArgs;
+	for (int i = 0; i < args.size(); i++) {
+		std::string arg = args[i];
+		if (arg.compare(0, THREADSOPTION.size(), THREADSOPTION) == 0) {
+			const char* value = args[i] + THREADSOPTION.size();
+			if (!isInteger(value)) {
+				std::cout << "Thread number must be an integer\n";
+				return EXIT_FAILURE;
+			}
+			threadNum = atoi(value);
+		}
+		else if (arg.compare(0, OUTPUTOPTION.size(), OUTPUTOPTION) == 0) {
+			outputPath = arg.substr(OUTPUTOPTION.size());
+		}
+		else if (arg.compare(0, BVHOPTION.size(), BVHOPTION) == 0) {
+			std::string value = arg.substr(BVHOPTION.size());
+			if (value == "mean") buildStrategy = BuildStrategies::centroidMean;
+			else if (value == "sah") buildStrategy = BuildStrategies::sah;
+			else {
+				std::cout << "BVH build strategy must be 'mean' or 'sah'\n";
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg.compare(0, BVHWIDTHOPTION.size(), BVHWIDTHOPTION) == 0) {
+			std::string value = arg.substr(BVHWIDTHOPTION.size());
+			if (value == "2" || value == "4" || value == "8") bvhWidth = atoi(value.c_str());
+			else {
+				std::cout << "BVH width must be 2, 4 or 8\n";
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg.compare(0, PACKETSOPTION.size(), PACKETSOPTION) == 0) {
+			std::string value = arg.substr(PACKETSOPTION.size());
+			if (value == "0" || value == "2" || value == "8") packetSize = atoi(value.c_str());
+			else {
+				std::cout << "Packet size must be 0, 2 or 8\n";
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg.compare(0, CACHEOPTION.size(), CACHEOPTION) == 0) {
+			std::string value = arg.substr(CACHEOPTION.size());
+			if (value == "on") useModelCache = true;
+			else if (value == "off") useModelCache = false;
+			else {
+				std::cout << "Model cache must be 'on' or 'off'\n";
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg.compare(0, INGESTMEMORYOPTION.size(), INGESTMEMORYOPTION) == 0) {
+			const char* value = args[i] + INGESTMEMORYOPTION.size();
+			if (!isInteger(value) || atoi(value) < 0) {
+				std::cout << "Ingest memory must be a whole number of megabytes\n";
+				return EXIT_FAILURE;
+			}
+			ingestMemoryMB = atoi(value);
+		}
+		else if (arg.compare(0, PROGRESSIVEOPTION.size(), PROGRESSIVEOPTION) == 0) {
+			std::string value = arg.substr(PROGRESSIVEOPTION.size());
+			if (value == "on") isProgressive = true;
+			else if (value == "off") isProgressive = false;
+			else {
+				std::cout << "Progressive rendering must be 'on' or 'off'\n";
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg.compare(0, QUALITYOPTION.size(), QUALITYOPTION) == 0) {
+			const char* value = args[i] + QUALITYOPTION.size();
+			if (!isInteger(value) || atoi(value) < 1 || atoi(value) > Camera::maxQuality) {
+				std::cout << "Quality must be an integer from 1 to " << Camera::maxQuality << "\n";
+				return EXIT_FAILURE;
+			}
+			quality = atoi(value);
+		}
+		else if (arg.compare(0, INTERACTIVEOPTION.size(), INTERACTIVEOPTION) == 0) {
+			std::string value = arg.substr(INTERACTIVEOPTION.size());
+			if (value == "on") isInteractive = true;
+			else if (value == "off") isInteractive = false;
+			else {
+				std::cout << "Interactive mode must be 'on' or 'off'\n";
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg.compare(0, REPROJECTOPTION.size(), REPROJECTOPTION) == 0) {
+			std::string value = arg.substr(REPROJECTOPTION.size());
+			if (value == "on") useReprojection = true;
+			else if (value == "off") useReprojection = false;
+			else {
+				std::cout << "Reprojection must be 'on' or 'off'\n";
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg.compare(0, SCENEOPTION.size(), SCENEOPTION) == 0) {
+			scenePath = arg.substr(SCENEOPTION.size());
+		}
+		else if (arg.compare(0, VIEWSOPTION.size(), VIEWSOPTION) == 0) {
+			viewsPath = arg.substr(VIEWSOPTION.size());
+		}
+		else if (arg.compare(0, EXPOSUREOPTION.size(), EXPOSUREOPTION) == 0) {
+			const char* value = args[i] + EXPOSUREOPTION.size();
+			if (!isFloat(value) || atof(value) <= 0.0) {
+				std::cout << "Exposure must be a positive decimal number\n";
+				return EXIT_FAILURE;
+			}
+			postProcess.setExposure(atof(value));
+		}
+		else if (arg.compare(0, TONEMAPOPTION.size(), TONEMAPOPTION) == 0) {
+			std::string value = arg.substr(TONEMAPOPTION.size());
+			if (value == "reinhard") postProcess.setToneCurve(ToneCurves::reinhard);
+			else if (value == "clamp") postProcess.setToneCurve(ToneCurves::clamp);
+			else {
+				std::cout << "Tone curve must be 'reinhard' or 'clamp'\n";
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg.compare(0, DITHEROPTION.size(), DITHEROPTION) == 0) {
+			std::string value = arg.substr(DITHEROPTION.size());
+			if (value == "on") postProcess.setDithered(true);
+			else if (value == "off") postProcess.setDithered(false);
+			else {
+				std::cout << "Dithering must be 'on' or 'off'\n";
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg.compare(0, HEATMAPOPTION.size(), HEATMAPOPTION) == 0) {
+			heatmapPath = arg.substr(HEATMAPOPTION.size());
+		}
+		else if (arg.compare(0, SIMDOPTION.size(), SIMDOPTION) == 0) {
+			// Instruction sets the CPU doesn't support fall back to the widest one it does
+			std::string value = arg.substr(SIMDOPTION.size());
+			if (value == "scalar") BVH::setSIMDLevel(SIMDLevels::scalar);
+			else if (value == "sse") BVH::setSIMDLevel(SIMDLevels::sse);
+			else if (value == "avx2") BVH::setSIMDLevel(SIMDLevels::avx2);
+			else {
+				std::cout << "SIMD instruction set must be 'scalar', 'sse' or 'avx2'\n";
+				return EXIT_FAILURE;
+			}
+		}
+		else {
+			remainingArgs.push_back(args[i]);
 		}
 	}
+	args.swap(remainingArgs);
 	return EXIT_SUCCESS;
 }
 
-bool checkCommandLineArgs(char *argv[]) {
-	// Check if number of arguments different than required
-	if (sizeof(*argv) / sizeof(char) != 5) {
+bool checkCommandLineArgs(int argc, char *argv[]) {
+	// Check if number of arguments fewer than required. Models may all be given by a scene file instead
+	if (argc < (scenePath.empty() ? NUMCOMMANDLINEARGS : NUMCOMMANDLINEARGS - 1)) {
 		std::cout << "Wrong number of command line arguments\n";
-		std::cout << "Argument syntax: width height fieldOfView OBJfilename\n";
+		std::cout << "Argument syntax: width height fieldOfView OBJfilename [OBJfilename...] [--scene=scene.txt] [--threads=N] [--output=image.ppm] [--bvh=mean|sah] [--bvh-width=2|4|8] [--packets=0|2|8] [--simd=scalar|sse|avx2] [--cache=on|off] [--ingest-memory=MB] [--progressive=on|off] [--quality=1-5] [--interactive=on|off] [--reproject=on|off] [--views=views.txt] [--exposure=F] [--tonemap=reinhard|clamp] [--dither=on|off] [--heatmap=heatmap.ppm]\n";
 		return EXIT_FAILURE;
 	}
 	// Check if the supplied width and height are integers
@@ -96,35 +322,175 @@ bool checkCommandLineArgs(char *argv[]) {
 		std::cout << "Camera field of view must be a decimal number\n";
 		return EXIT_FAILURE;
 	}
+	// Each view is written to an image numbered from the output path, so one is needed
+	if (!viewsPath.empty() && outputPath.empty()) {
+		std::cout << "Rendering views from a views file needs an output image path to number them from\n";
+		return EXIT_FAILURE;
+	}
+	if (!heatmapPath.empty() && !TRAVERSAL_STATS) {
+		std::cout << "Traversal counting is compiled out, so heatmaps need a build with TRAVERSAL_STATS defined as 1\n";
+		return EXIT_FAILURE;
+	}
+	// Batches render each view with a camera of their own, which isn't kept
+	if (!heatmapPath.empty() && !viewsPath.empty()) {
+		std::cout << "Heatmaps can only be written for a single render, not a batch of views\n";
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+// Read a light from the rest of a scene file line starting with 'light', as
+// 'point|directional x y z [strength | r g b]', where x, y and z are a point light's position or the
+// direction a directional light shines towards
+bool readLight(std::istringstream& stream, Light& light) {
+	std::string type;
+	if (!(stream >> type)) return false;
+	if (type == "point") light.type = LightTypes::point;
+	else if (type == "directional") light.type = LightTypes::directional;
+	else return false;
+	std::vector<float> values;
+	float value;
+	while (stream >> value) values.push_back(value);
+	if (!stream.eof() || (values.size() != 3 && values.size() != 4 && values.size() != 6)) return false;
+	light.vector = Vec3(values[0], values[1], values[2]);
+	if (values.size() == 3) light.colour = Vec3(1.0f, 1.0f, 1.0f);
+	else if (values.size() == 4) light.colour = Vec3(values[3], values[3], values[3]);
+	else light.colour = Vec3(values[3], values[4], values[5]);
+	return light.type == LightTypes::point || light.vector.getLength() > 0.0f;
+}
+
+// Read the placements listed in a scene file, one per line as
+// 'OBJfilename [x y z [rotX rotY rotZ [flipX flipY flipZ]]]', with rotations in degrees and
+// reflections as 0 or 1, and the lights, as lines starting with 'light' (see 'readLight').
+// Blank lines and lines starting with '#' are skipped
+bool readSceneFile(const std::string& path, std::vector<Placement>& placements, std::vector<Light>& lights) {
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		std::cout << "Unable to open scene file " << path << "\n";
+		return EXIT_FAILURE;
+	}
+	std::string line;
+	int lineNum = 0;
+	while (std::getline(file, line)) {
+		lineNum++;
+		std::istringstream stream(line);
+		Placement placement;
+		if (!(stream >> placement.filename) || placement.filename[0] == '#') continue;
+		if (placement.filename == "light") {
+			Light light;
+			if (!readLight(stream, light)) {
+				std::cout << "Scene file " << path << " line " << lineNum << " should be 'light point|directional x y z [strength | r g b]'\n";
+				return EXIT_FAILURE;
+			}
+			lights.push_back(light);
+			continue;
+		}
+		// Each group of three values is optional, but a group can't be given in part
+		std::vector<float> values;
+		float value;
+		while (stream >> value) values.push_back(value);
+		if (!stream.eof() || values.size() % 3 != 0 || values.size() > 9) {
+			std::cout << "Scene file " << path << " line " << lineNum << " should be 'OBJfilename [x y z [rotX rotY rotZ [flipX flipY flipZ]]]'\n";
+			return EXIT_FAILURE;
+		}
+		values.resize(9, 0.0f);
+		placement.position = Vec3(values[0], values[1], values[2]);
+		placement.transform = Transform(values[3], values[4], values[5], values[6] != 0.0f, values[7] != 0.0f, values[8] != 0.0f);
+		placements.push_back(placement);
+	}
+	return EXIT_SUCCESS;
+}
+
+// Read the camera views listed in a views file, one per line as
+// 'x y z [yaw pitch [fieldOfView [width height]]]', with angles in degrees. Values left out are
+// taken from the command line, or face forwards. Blank lines and lines starting with '#' are skipped
+bool readViewsFile(const std::string& path, std::vector<View>& views) {
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		std::cout << "Unable to open views file " << path << "\n";
+		return EXIT_FAILURE;
+	}
+	std::string line;
+	int lineNum = 0;
+	while (std::getline(file, line)) {
+		lineNum++;
+		size_t firstChar = line.find_first_not_of(" \t\r");
+		if (firstChar == std::string::npos || line[firstChar] == '#') continue;
+		std::istringstream stream(line);
+		std::vector<float> values;
+		float value;
+		while (stream >> value) values.push_back(value);
+		int valueNum = values.size();
+		if (!stream.eof() || (valueNum != 3 && valueNum != 5 && valueNum != 6 && valueNum != 8)
+			|| (valueNum == 8 && (values[6] < 1.0f || values[7] < 1.0f))) {
+			std::cout << "Views file " << path << " line " << lineNum << " should be 'x y z [yaw pitch [fieldOfView [width height]]]'\n";
+			return EXIT_FAILURE;
+		}
+		View view;
+		view.position = Vec3(values[0], values[1], values[2]);
+		if (valueNum >= 5) {
+			view.yaw = values[3];
+			view.pitch = values[4];
+		}
+		view.fov = valueNum >= 6 ? values[5] : camFOV;
+		view.width = valueNum >= 8 ? (int)values[6] : WIDTH;
+		view.height = valueNum >= 8 ? (int)values[7] : HEIGHT;
+		views.push_back(view);
+	}
 	return EXIT_SUCCESS;
 }
 
-bool parseCommandLineArgs(int argc, char *argv[], std::vector<std::string>& modelFileNames) {
+bool parseCommandLineArgs(int _argc, char *_argv[], std::vector<Placement>& placements, std::vector<Light>& lights) {
+	std::vector<char*> args(_argv, _argv + _argc);
+	if (parseOptionalArgs(args) == EXIT_FAILURE) return EXIT_FAILURE;
+	int argc = (int)args.size();
+	char** argv = args.data();
 	// Check the command line arguments for syntax errors
-	if (checkCommandLineArgs(argv) == EXIT_FAILURE)	return EXIT_FAILURE;
+	if (checkCommandLineArgs(argc, argv) == EXIT_FAILURE)	return EXIT_FAILURE;
 
 	setWindowDimensions(
 		strtol(argv[1], nullptr, 0),
 		strtol(argv[2], nullptr, 0));
 	camFOV = atof(argv[3]);
+	// Models given on the command line are placed as they are
 	for (int i = 4; i < argc; i++) {
-		modelFileNames.push_back(std::string(argv[i]));
+		Placement placement;
+		placement.filename = argv[i];
+		placements.push_back(placement);
 	}
+	if (!scenePath.empty()) return readSceneFile(scenePath, placements, lights);
 	return EXIT_SUCCESS;
 }
 
-std::shared_ptr<Camera> initCam(std::vector<std::string>& filenames) {
+std::shared_ptr<Camera> initCam(std::vector<Placement>& placements, const std::vector<Light>& lights) {
 	std::shared_ptr<Camera> cam(new Camera(camPos, WIDTH, HEIGHT, camFOV));
-	for (int i = 0; i < filenames.size(); i++) {
-		std::string path = root + filenames[i];
-		std::shared_ptr<Model> model = std::make_shared<Model>(path, Vec3(), transform);
-		cam->insertModel(model);
+	// The render pool also builds the models' hierarchies
+	std::shared_ptr<ThreadPool> pool = std::make_shared<ThreadPool>(threadNum);
+	cam->setThreadPool(pool);
+	cam->setPacketSize(packetSize);
+	ModelLibrary library(transform, buildStrategy, bvhWidth, pool.get(), useModelCache, (size_t)ingestMemoryMB << 20);
+	for (int i = 0; i < placements.size(); i++) {
+		int modelNum = library.getModelNum();
+		Instance instance = library.createInstance(root + placements[i].filename, placements[i].position, placements[i].transform);
+		cam->insertInstance(instance);
+		// Only the first placement of each model loads it
+		if (library.getModelNum() == modelNum) continue;
+		const Model& model = instance.getModel();
+		std::cout << "Loaded " << placements[i].filename << (placements[i].transform.flipsWinding() ? " (mirrored)" : "") << ": "
+			<< model.getTriangleNum() << " triangles, " << model.getBVHNodeNum() << " BVH nodes, SAH cost " << model.getBVHCost();
+		if (model.isLoadedFromCache()) std::cout << ", from cache\n";
+		else std::cout << ", built in " << model.getBVHBuildTime() << "s\n";
+	}
+	std::cout << "Placed " << placements.size() << " instances of " << library.getModelNum() << " models\n";
+	for (const Light& light : lights) {
+		cam->insertLight(light);
 	}
+	if (!lights.empty()) std::cout << "Lit by " << lights.size() << " lights, casting shadows\n";
 	return cam;
 }
 
 float getTimeElapsed(std::chrono::steady_clock::time_point start) {
-	auto end = std::chrono::high_resolution_clock::now();
+	auto end = std::chrono::steady_clock::now();
 	auto dur = end - start;
 	auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(dur).count();
 	return ms / 1000.0;
@@ -135,39 +501,192 @@ void outputRenderInfo(std::chrono::steady_clock::time_point start) {
 	std::cout << "Time taken (s): " << getTimeElapsed(start) << "\n";
 	std::cout << "Field of View (Degrees): " << camFOV << "\n";
 	std::cout << "Display Resolution: " << WIDTH << " x " << HEIGHT << "\n";
+	std::cout << "Render Threads: " << (threadNum > 0 ? threadNum : std::max(1, (int)std::thread::hardware_concurrency())) << "\n";
+	std::cout << "Triangle Kernel: " << getSIMDLevelName(BVH::getSIMDLevel()) << "\n";
+	if (isProgressive || quality < Camera::maxQuality) std::cout << "Progressive Passes: " << quality << "/" << Camera::maxQuality << "\n";
+}
+
+// Write heatmaps of the work done tracing each pixel of the camera's last render, and print histograms of it
+bool writeTraversalStats(const Camera& cam) {
+#if TRAVERSAL_STATS
+	if (heatmapPath.empty()) return true;
+	cam.getTraversalStats().printHistograms();
+	return cam.getTraversalStats().writeHeatmaps(heatmapPath);
+#else
+	return true;
+#endif
+}
+
+void presentFramebuffer(Context context, const Framebuffer& framebuffer, ThreadPool* threadPool) {
+	std::vector<uint8_t> rgb;
+	framebuffer.toRGB24(rgb, postProcess, threadPool);
+	SDL_UpdateTexture(context.texture, NULL, rgb.data(), framebuffer.getWidth() * 3);
+	SDL_RenderCopy(context.renderer, context.texture, NULL, NULL);
+	SDL_RenderPresent(context.renderer);
 }
 
-void mainLoop(Context context) {
+// Change the exposure for a press of '=' (brighter) or '-' (darker), returning whether it changed
+bool handleExposureInput(const SDL_Event& event) {
+	if (event.type != SDL_KEYDOWN) return false;
+	if (event.key.keysym.sym == SDLK_EQUALS) postProcess.setExposure(postProcess.getExposure() * EXPOSURE_STEP);
+	else if (event.key.keysym.sym == SDLK_MINUS) postProcess.setExposure(postProcess.getExposure() / EXPOSURE_STEP);
+	else return false;
+	std::cout << "Exposure: " << postProcess.getExposure() << "\n";
+	return true;
+}
+
+// Wait for the window to be closed, redrawing the last frame whenever anything else happens to it. Changing
+// the exposure only post-processes the frame again, as the framebuffer keeps the colours it was traced with
+void mainLoop(Context context, const Framebuffer& framebuffer, ThreadPool* threadPool) {
 	SDL_Event windowEvent;
-	while (true) {
-		if (SDL_PollEvent(&windowEvent)) {
-			if (SDL_QUIT == windowEvent.type) {
-				return;
-			}
+	while (SDL_WaitEvent(&windowEvent)) {
+		if (SDL_QUIT == windowEvent.type) {
+			return;
 		}
+		if (handleExposureInput(windowEvent)) {
+			presentFramebuffer(context, framebuffer, threadPool);
+			continue;
+		}
+		SDL_RenderCopy(context.renderer, context.texture, NULL, NULL);
 		SDL_RenderPresent(context.renderer);
 	}
 }
 
+// Move the camera for a key press or mouse drag, returning whether it moved. W, A, S and D move
+// forwards, left, back and right, E and Q move up and down, and the arrow keys or dragging with the
+// left mouse button held turn the camera. 'isQuit' is set if the window is closed or escape is pressed
+bool handleCameraInput(const SDL_Event& event, Camera& cam, bool& isQuit) {
+	if (event.type == SDL_QUIT) {
+		isQuit = true;
+		return false;
+	}
+	if (event.type == SDL_MOUSEMOTION && (event.motion.state & SDL_BUTTON_LMASK)) {
+		cam.rotate(event.motion.xrel * MOUSE_SENSITIVITY, -event.motion.yrel * MOUSE_SENSITIVITY);
+		return true;
+	}
+	if (event.type != SDL_KEYDOWN) return false;
+	switch (event.key.keysym.sym) {
+	case SDLK_w: cam.move(Vec3(0.0f, 0.0f, MOVE_STEP)); return true;
+	case SDLK_s: cam.move(Vec3(0.0f, 0.0f, -MOVE_STEP)); return true;
+	case SDLK_a: cam.move(Vec3(-MOVE_STEP, 0.0f, 0.0f)); return true;
+	case SDLK_d: cam.move(Vec3(MOVE_STEP, 0.0f, 0.0f)); return true;
+	// The top of the screen faces -y
+	case SDLK_e: cam.move(Vec3(0.0f, -MOVE_STEP, 0.0f)); return true;
+	case SDLK_q: cam.move(Vec3(0.0f, MOVE_STEP, 0.0f)); return true;
+	case SDLK_LEFT: cam.rotate(-TURN_STEP, 0.0f); return true;
+	case SDLK_RIGHT: cam.rotate(TURN_STEP, 0.0f); return true;
+	case SDLK_UP: cam.rotate(0.0f, TURN_STEP); return true;
+	case SDLK_DOWN: cam.rotate(0.0f, -TURN_STEP); return true;
+	case SDLK_ESCAPE: isQuit = true; return false;
+	default: return false;
+	}
+}
+
+// Re-render the scene each time the camera is moved, until the window is closed. The scene's models
+// and hierarchies are kept from the first frame, so each frame only traces rays
+void interactiveLoop(Context context, Camera& cam, Framebuffer& framebuffer) {
+	cam.setPrintsProgress(false);
+	Framebuffer reprojected;
+	SDL_Event event;
+	while (SDL_WaitEvent(&event)) {
+		// Every event queued up while the last frame was rendering is handled before the next one starts
+		bool isMoved = false;
+		bool isExposureChanged = false;
+		bool isQuit = false;
+		do {
+			isExposureChanged |= handleExposureInput(event);
+			isMoved |= handleCameraInput(event, cam, isQuit);
+		} while (!isQuit && SDL_PollEvent(&event));
+		if (isQuit) return;
+		if (!isMoved) {
+			// A new exposure is shown without tracing the frame again
+			if (isExposureChanged) presentFramebuffer(context, framebuffer, cam.getThreadPool().get());
+			else {
+				SDL_RenderCopy(context.renderer, context.texture, NULL, NULL);
+				SDL_RenderPresent(context.renderer);
+			}
+			continue;
+		}
+		auto start = std::chrono::steady_clock::now();
+		if (useReprojection && cam.reproject(framebuffer, reprojected)) {
+			presentFramebuffer(context, reprojected, cam.getThreadPool().get());
+		}
+		cam.renderProgressive(framebuffer, quality, [&](const Framebuffer& passFramebuffer, int pass, int stride) {
+			presentFramebuffer(context, passFramebuffer, cam.getThreadPool().get());
+			SDL_PumpEvents();
+		});
+		float frameTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		Vec3 camPosition = cam.getPosition();
+		std::ostringstream title;
+		title << "NEA - " << round(frameTime * 10.0f) / 10.0f << " ms (" << round(1000.0f / frameTime) << " fps)";
+		SDL_SetWindowTitle(context.window, title.str().c_str());
+		std::cout << "Frame time: " << frameTime << " ms, camera at (" << camPosition.x << ", " << camPosition.y << ", " << camPosition.z
+			<< ") facing yaw " << cam.getYaw() << ", pitch " << cam.getPitch() << "\n";
+	}
+}
+
 bool quit(Context context) {
+	SDL_DestroyTexture(context.texture);
 	SDL_DestroyWindow(context.window);
 	SDL_Quit();
 	return EXIT_SUCCESS;
 }
 
 int main(int argc, char *argv[]) {
-	std::vector<std::string> filenames;
-	if (parseCommandLineArgs(argc, argv, filenames) == EXIT_FAILURE) return EXIT_FAILURE;
+	std::vector<Placement> placements;
+	std::vector<Light> lights;
+	if (parseCommandLineArgs(argc, argv, placements, lights) == EXIT_FAILURE) return EXIT_FAILURE;
+
+	// Batches of views load the scene once, and render every view of it to its own image
+	if (!viewsPath.empty()) {
+		std::vector<View> views;
+		if (readViewsFile(viewsPath, views) == EXIT_FAILURE) return EXIT_FAILURE;
+		std::shared_ptr<Camera> cam = initCam(placements, lights);
+		BatchRenderer batch(cam->getScene(), cam->getThreadPool(), packetSize, quality);
+		batch.setPostProcess(postProcess);
+		auto start = std::chrono::steady_clock::now();
+		bool isWritten = batch.renderToFiles(views, outputPath);
+		outputRenderInfo(start);
+		std::cout << "Views Rendered: " << views.size() << "\n";
+		return isWritten ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// Headless renders go straight to an image file, without initialising SDL
+	if (!outputPath.empty()) {
+		std::shared_ptr<Camera> cam = initCam(placements, lights);
+		Framebuffer framebuffer(WIDTH, HEIGHT);
+		auto start = std::chrono::steady_clock::now();
+		// Stopping early needs a progressive render, even without a window to show the passes in
+		if (isProgressive || quality < Camera::maxQuality) cam->renderProgressive(framebuffer, quality);
+		else cam->renderImage(framebuffer);
+		outputRenderInfo(start);
+		bool isWritten = framebuffer.writePPM(outputPath, postProcess, cam->getThreadPool().get());
+		isWritten &= writeTraversalStats(*cam);
+		return isWritten ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
 
 	Context context = initialise();
 	if (context.initFailure == EXIT_FAILURE) return EXIT_FAILURE;
 
-	std::shared_ptr<Camera> cam = initCam(filenames);
-	auto start = std::chrono::high_resolution_clock::now();
-	cam->renderImage(context.renderer, WIDTH, HEIGHT);
+	std::shared_ptr<Camera> cam = initCam(placements, lights);
+	Framebuffer framebuffer(WIDTH, HEIGHT);
+	auto start = std::chrono::steady_clock::now();
+	if (isProgressive || quality < Camera::maxQuality) {
+		// Show each pass as soon as it's done, keeping the window responsive in between
+		cam->renderProgressive(framebuffer, quality, [&](const Framebuffer& passFramebuffer, int pass, int stride) {
+			presentFramebuffer(context, passFramebuffer, cam->getThreadPool().get());
+			SDL_PumpEvents();
+		});
+	}
+	else {
+		cam->renderImage(framebuffer);
+	}
 	outputRenderInfo(start);
+	writeTraversalStats(*cam);
+	presentFramebuffer(context, framebuffer, cam->getThreadPool().get());
 
-	mainLoop(context);
+	if (isInteractive) interactiveLoop(context, *cam, framebuffer);
+	else mainLoop(context, framebuffer, cam->getThreadPool().get());
 
 	return quit(context);
 }
\ No newline at end of file
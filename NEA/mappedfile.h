@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+
+// Read-only view of a whole file, mapped into memory rather than read into a buffer,
+// so that only the pages actually touched are loaded from disk
+struct MappedFile {
+private:
+	const char* data = nullptr;
+	size_t size = 0;
+	bool isOpenFlag = false;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+public:
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile& other) = delete;
+	MappedFile& operator=(const MappedFile& other) = delete;
+
+	bool open(const char* path);
+	void close();
+	bool isOpen() const;
+	// Empty files are mapped with a null data pointer
+	const char* getData() const;
+	size_t getSize() const;
+};
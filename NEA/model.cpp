@@ -1,5 +1,7 @@
 
 #include "model.h"
+#include "modelcache.h"
+#include "trianglefile.h"
 
 // --------------------------------- //
 //               Model               //
@@ -8,25 +10,64 @@
 Model::Model(
 	std::string filePath,
 	Vec3 _position,
-	Transform transform)
-	: position(_position) {
-	std::vector<uint32_t> vertexIndices;
-	std::vector<uint32_t> normalIndices;
-	loadOBJ(filePath.c_str(), vertices, normals, vertexIndices, normalIndices, transform);
-	int triNum = normalIndices.size() / 3;
-	for (int i = 0; i < triNum; i++) {
-		uint32_t index = i * 3;
-		triangles.push_back(
-			Triangle(
-				vertexIndices[index] - 1,
-				vertexIndices[index + 1] - 1,
-				vertexIndices[index + 2] - 1,
-				normalIndices[index] - 1,
-				i,
-				std::shared_ptr<Model>(this)
-			));
+	Transform transform,
+	BuildStrategies::BuildStrategy strategy,
+	int bvhWidth,
+	ThreadPool* threadPool,
+	bool useCache,
+	size_t ingestMemoryLimit)
+	: position(_position), buildStrategy(strategy) {
+	ModelCacheKey cacheKey;
+	std::string cachePath;
+	if (useCache && calcModelCacheKey(filePath, transform, strategy, bvhWidth, ingestMemoryLimit, cacheKey)) {
+		cachePath = getModelCachePath(filePath, cacheKey);
+		if (readCache(cachePath, cacheKey.key)) {
+			isCached = true;
+			return;
+		}
+		// Discard anything read before the cache turned out to be unusable
+		triangles.clear();
+		vertices.clear();
+		normals.clear();
+	}
+	bool isStreamed = false;
+	if (ingestMemoryLimit > 0) {
+		TriangleFile triangleFile;
+		if (triangleFile.isOpen()) {
+			streamOBJ(filePath.c_str(), vertices, normals, triangleFile, transform);
+			bvh = BVH(triangleFile, this, strategy, bvhWidth, threadPool, ingestMemoryLimit);
+			// Triangles are only needed for shading from here on, so are read back last
+			triangleFile.readAll(triangles);
+			isStreamed = true;
+		}
+		else {
+			printf("Unable to create a temporary file, so loading %s without streaming\n", filePath.c_str());
+		}
+	}
+	if (!isStreamed) {
+		{
+			std::vector<uint32_t> vertexIndices;
+			std::vector<uint32_t> normalIndices;
+			loadOBJ(filePath.c_str(), vertices, normals, vertexIndices, normalIndices, transform, threadPool);
+			int triNum = normalIndices.size() / 3;
+			triangles.reserve(triNum);
+			for (int i = 0; i < triNum; i++) {
+				uint32_t index = i * 3;
+				triangles.push_back(
+					Triangle(
+						vertexIndices[index],
+						vertexIndices[index + 1],
+						vertexIndices[index + 2],
+						normalIndices[index],
+						i));
+			}
+			// The indices are freed before building, as they are no longer needed
+		}
+		bvh = BVH(triangles, this, strategy, bvhWidth, threadPool);
+	}
+	if (!cachePath.empty() && !writeCache(cachePath, cacheKey.key)) {
+		printf("Unable to write model cache %s\n", cachePath.c_str());
 	}
-	rootNode = std::make_shared<BVHNode>(triangles, this);
 }
 
 Model::Model(const Model& _model)
@@ -34,7 +75,41 @@ Model::Model(const Model& _model)
 	triangles(_model.triangles),
 	vertices(_model.vertices),
 	normals(_model.normals),
-	rootNode(std::move(_model.rootNode)) {
+	bvh(_model.bvh),
+	buildStrategy(_model.buildStrategy),
+	isCached(_model.isCached) {
+}
+
+UpdateResults::UpdateResult Model::updateVertices(
+	const std::vector<Vec3>& newVertices,
+	const std::vector<Vec3>& newNormals,
+	ThreadPool* threadPool) {
+	if (newVertices.size() != vertices.size()) return UpdateResults::invalid;
+	if (!newNormals.empty() && newNormals.size() != normals.size()) return UpdateResults::invalid;
+	vertices = newVertices;
+	if (!newNormals.empty()) normals = newNormals;
+	if (bvh.refit(this, threadPool) <= BVH::maxRefitCostRatio) return UpdateResults::refitted;
+	// Streamed models are rebuilt in memory, as their triangles are all held in memory by now anyway
+	bvh = BVH(triangles, this, buildStrategy, bvh.getWidth(), threadPool);
+	return UpdateResults::rebuilt;
+}
+
+bool Model::readCache(const std::string& cachePath, uint64_t key) {
+	ModelCacheReader reader;
+	return reader.open(cachePath, key)
+		&& reader.readArray(vertices)
+		&& reader.readArray(normals)
+		&& reader.readArray(triangles)
+		&& bvh.readCache(reader, this);
+}
+
+bool Model::writeCache(const std::string& cachePath, uint64_t key) const {
+	ModelCacheWriter writer;
+	writer.writeArray(vertices);
+	writer.writeArray(normals);
+	writer.writeArray(triangles);
+	bvh.writeCache(writer);
+	return writer.save(cachePath, key);
 }
 
 Triangle Model::getTriangle(int index) const {
@@ -49,12 +124,44 @@ int Model::getVertexNum() const {
 	return vertices.size();
 }
 
+int Model::getTriangleNum() const {
+	return triangles.size();
+}
+
+int Model::getBVHNodeNum() const {
+	return bvh.getNodeNum();
+}
+
+float Model::getBVHCost() const {
+	return bvh.calcSAHCost();
+}
+
+float Model::getBVHBuildTime() const {
+	return bvh.getBuildTime();
+}
+
+bool Model::isLoadedFromCache() const {
+	return isCached;
+}
+
+AABB Model::getBounds() const {
+	return bvh.getBounds();
+}
+
 Vec3 Model::getNormal(int index) const {
 	return normals[index];
 }
 
 bool Model::rayIntersection(const Ray& ray, float& t, int& triangleIndex) const {
-	return rootNode->rayIntersection(ray, t, triangleIndex);
+	return bvh.rayIntersection(ray, t, triangleIndex);
+}
+
+bool Model::isOccluded(const Ray& ray, float tMax) const {
+	return bvh.isOccluded(ray, tMax);
+}
+
+uint64_t Model::rayPacketIntersection(RayPacket& packet, uint64_t rayMask) const {
+	return bvh.rayPacketIntersection(packet, rayMask);
 }
 
 Vec3 Model::getPosition() const {
@@ -67,51 +174,9 @@ Vec3 Model::getPosition() const {
 
 Triangle::Triangle(
 	uint32_t _v0Index, uint32_t _v1Index, uint32_t _v2Index,
-	uint32_t _normalIndex, uint32_t _triangleIndex,
-	std::shared_ptr<Model> _parent)
-	: v0Index(_v0Index), v1Index(_v1Index), v2Index(_v2Index), 
-	normalIndex(_normalIndex), triangleIndex(_triangleIndex),
-	parent(_parent) {
-	
-	planeOffset = -parent->getNormal(normalIndex).dot(parent->getVertex(v0Index));
-	center = (parent->getVertex(v0Index) + parent->getVertex(v1Index) + parent->getVertex(v2Index)) / 3.0f;
-}
-
-Triangle::Triangle(const Triangle& other) 
-	: v0Index(other.v0Index), v1Index(other.v1Index), v2Index(other.v2Index),
-	normalIndex(other.normalIndex), triangleIndex(other.triangleIndex),
-	parent(other.parent), planeOffset(other.planeOffset), center(other.center) {
-}
-
-bool Triangle::rayIntersection(const Ray& ray, const Vec3& offset, float& t) const {
-	// Mller-Trumbore algorithm
-	//https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle/moller-trumbore-ray-triangle-intersection
-	//http://www.lighthouse3d.com/tutorials/maths/ray-triangle-intersection/
-	Vec3 rayOrigin = ray.getOrigin();
-	Vec3 rayDirection = ray.getDirection();
-	Vec3 v0 = parent->getVertex(v0Index) + offset;
-	Vec3 v1 = parent->getVertex(v1Index) + offset;
-	Vec3 v2 = parent->getVertex(v2Index) + offset;
-
-	Vec3 edge0 = v1 - v0;
-	Vec3 edge1 = v2 - v0;
-	Vec3 pvec = rayDirection.cross(edge1);
-	float det = edge0.dot(pvec);
-	if (det <= 0.00001f) return false;
-	float invDet = 1 / det;
-
-	Vec3 tvec = rayOrigin - v0;
-	float u = tvec.dot(pvec) * invDet;
-	if (u < 0.0f || u > 1.0f) return false;
-	Vec3 qvec = tvec.cross(edge0);
-	float v = rayDirection.dot(qvec) * invDet;
-	if (v < 0.0f || u + v > 1.0f) return false;
-	t = edge1.dot(qvec) * invDet;
-	return true;
-}
-
-void Triangle::setParent(std::shared_ptr<Model> _parent) {
-	parent = _parent;
+	uint32_t _normalIndex, uint32_t _triangleIndex)
+	: v0Index(_v0Index), v1Index(_v1Index), v2Index(_v2Index),
+	normalIndex(_normalIndex), triangleIndex(_triangleIndex) {
 }
 
 int Triangle::getv0Index() const {
@@ -132,8 +197,4 @@ int Triangle::getNormalIndex() const {
 
 int Triangle::getTriangleIndex() const {
 	return triangleIndex;
-}
-
-Vec3 Triangle::getCenter() const {
-	return center;
 }
\ No newline at end of file
@@ -1,58 +1,91 @@
 #pragma once
 
-struct BVHNode;
+struct BVH;
 
 #include <vector>
 #include <memory>
 #include "BVH.h"
 #include "modelloader.h"
 
+namespace UpdateResults {
+	enum UpdateResult {
+		refitted, // The hierarchy was refitted to the new vertices
+		rebuilt,  // Refitting degraded the hierarchy too far, so it was rebuilt
+		invalid   // The vertices given don't match the model's, so nothing was changed
+	};
+}
+
 struct Model {
 private:
 	Vec3 position;
 	std::vector<Triangle> triangles;
 	std::vector<Vec3> vertices;
 	std::vector<Vec3> normals;
-	std::shared_ptr<BVHNode> rootNode;
+	BVH bvh;
+	// Strategy the hierarchy was built with, for rebuilding it once the vertices have moved
+	BuildStrategies::BuildStrategy buildStrategy;
+	bool isCached = false;
+
+	bool readCache(const std::string& cachePath, uint64_t key);
+	bool writeCache(const std::string& cachePath, uint64_t key) const;
 public:
 	Vec3 colour = Vec3(1.0f, 0.0f, 0.0f);
 
 	Model(
 		std::string filePath,
 		Vec3 _position = Vec3(),
-		Transform transform = Transform());
+		Transform transform = Transform(),
+		BuildStrategies::BuildStrategy strategy = BuildStrategies::sah,
+		int bvhWidth = 2,
+		ThreadPool* threadPool = nullptr,
+		// Load the mesh and hierarchy from a cache file made by an earlier run, if its
+		// input is unchanged, or create one for the next run
+		bool useCache = false,
+		// Stream the file from disk, building with about this many bytes of temporary memory, or zero
+		// to load it all at once. Only worthwhile for meshes too large to load the usual way
+		size_t ingestMemoryLimit = 0);
 	Model(const Model& _object);
+	// Move the model's vertices, for an animated or deformed mesh, keeping its triangles. The vertices
+	// must be given in the model's space, in the same order and number as loaded. Normals are replaced
+	// if given, in the same way, or are otherwise left as they were. The hierarchy is refitted to the
+	// new vertices, and only rebuilt if that leaves it too much more costly to trace than when built
+	UpdateResults::UpdateResult updateVertices(
+		const std::vector<Vec3>& newVertices,
+		const std::vector<Vec3>& newNormals = std::vector<Vec3>(),
+		ThreadPool* threadPool = nullptr);
 	Triangle getTriangle(int index) const;
 	Vec3 getPosition() const;
 	Vec3 getVertex(int index) const;
 	int getVertexNum() const;
+	int getTriangleNum() const;
+	int getBVHNodeNum() const;
+	float getBVHCost() const;
+	float getBVHBuildTime() const;
+	bool isLoadedFromCache() const;
+	AABB getBounds() const;
 	Vec3 getNormal(int index) const;
 	bool rayIntersection(const Ray& ray, float& t, int& triangleIndex) const;
+	bool isOccluded(const Ray& ray, float tMax) const;
+	uint64_t rayPacketIntersection(RayPacket& packet, uint64_t rayMask) const;
 };
 
+// Indices of a triangle's vertices and normal within its model. The
+// intersection-ready form of each triangle is precomputed by the model's BVH
 struct Triangle {
 private:
 	uint32_t v0Index, v1Index, v2Index;
 	uint32_t normalIndex;
 	uint32_t triangleIndex;
-	std::shared_ptr<Model> parent;
-	float planeOffset;
-	Vec3 center;
 public:
 	Triangle(
 		uint32_t _v0Index = -1,
 		uint32_t _v1Index = -1,
 		uint32_t _v2Index = -1,
 		uint32_t _normalIndex = -1,
-		uint32_t _triangleIndex = -1,
-		std::shared_ptr<Model> _parent = nullptr);
-	Triangle(const Triangle& other);
-	bool rayIntersection(const Ray& ray, const Vec3& offset, float& t) const;
-	void setParent(std::shared_ptr<Model> parent);
+		uint32_t _triangleIndex = -1);
 	int getv0Index() const;
 	int getv1Index() const;
 	int getv2Index() const;
 	int getNormalIndex() const;
 	int getTriangleIndex() const;
-	Vec3 getCenter() const;
-};
\ No newline at end of file
+};
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include "modelcache.h"
+#include "transform.h"
+
+static const char MAGIC[8] = { 'N', 'E', 'A', 'C', 'A', 'C', 'H', 'E' };
+// Sections start on cache line boundaries, so that mapped arrays are as aligned as allocated ones
+static constexpr uint64_t SECTION_ALIGNMENT = 64;
+static constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+static constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+struct ModelCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t sectionNum;
+	uint64_t key;
+	// Checked on loading, to catch files that were only partly written
+	uint64_t fileSize;
+};
+
+// FNV-1a, taking eight bytes at a time so that large files are hashed quickly
+static uint64_t hashBytes(const void* data, size_t size, uint64_t hash = FNV_OFFSET_BASIS) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		memcpy(&word, bytes + i, 8);
+		hash = (hash ^ word) * FNV_PRIME;
+	}
+	for (; i < size; i++) {
+		hash = (hash ^ bytes[i]) * FNV_PRIME;
+	}
+	return hash;
+}
+
+static uint64_t alignOffset(uint64_t offset) {
+	return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+bool calcModelCacheKey(
+	const std::string& objPath,
+	const Transform& transform,
+	int buildStrategy,
+	int bvhWidth,
+	size_t ingestMemoryLimit,
+	ModelCacheKey& cacheKey) {
+	Mat3 matrix = transform.getMatrix();
+	float matrixValues[9] = {
+		matrix.x0, matrix.y0, matrix.z0,
+		matrix.x1, matrix.y1, matrix.z1,
+		matrix.x2, matrix.y2, matrix.z2 };
+	// Streamed models are built differently, depending on the memory they are allowed
+	uint64_t options[4] = { transform.flipsWinding(), (uint64_t)buildStrategy, (uint64_t)bvhWidth, ingestMemoryLimit };
+	cacheKey.optionsHash = hashBytes(matrixValues, sizeof(matrixValues));
+	cacheKey.optionsHash = hashBytes(options, sizeof(options), cacheKey.optionsHash);
+
+	MappedFile file;
+	if (!file.open(objPath.c_str())) return false;
+	cacheKey.key = hashBytes(file.getData(), file.getSize(), cacheKey.optionsHash);
+	return true;
+}
+
+std::string getModelCachePath(const std::string& objPath, const ModelCacheKey& cacheKey) {
+	// Each set of options gets its own file, so that one OBJ file loaded with two
+	// transforms doesn't rewrite a single cache on every run
+	char name[32];
+	snprintf(name, sizeof(name), ".%016llx.cache", (unsigned long long)cacheKey.optionsHash);
+	return objPath + name;
+}
+
+// ------------------------------------- //
+//               Cache Writer            //
+// ------------------------------------- //
+
+void ModelCacheWriter::writeSection(const void* data, uint64_t count, uint32_t elementSize) {
+	// Offsets are relative to the body until the size of the section table is known
+	uint64_t offset = alignOffset(bodySize);
+	bodySize = offset + count * elementSize;
+	sections.push_back(ModelCacheSection{ offset, count, elementSize, 0 });
+	sectionData.push_back(data);
+}
+
+bool ModelCacheWriter::save(const std::string& path, uint64_t key) const {
+	uint64_t bodyStart = alignOffset(sizeof(ModelCacheHeader) + sections.size() * sizeof(ModelCacheSection));
+	ModelCacheHeader header;
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = MODEL_CACHE_VERSION;
+	header.sectionNum = sections.size();
+	header.key = key;
+	header.fileSize = bodyStart + bodySize;
+	std::vector<ModelCacheSection> fileSections = sections;
+	for (ModelCacheSection& section : fileSections) {
+		section.offset += bodyStart;
+	}
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file == nullptr) return false;
+	const char padding[SECTION_ALIGNMENT] = {};
+	uint64_t position = sizeof(header) + fileSections.size() * sizeof(ModelCacheSection);
+	bool isWritten =
+		fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(fileSections.data(), sizeof(ModelCacheSection), fileSections.size(), file) == fileSections.size();
+	for (int i = 0; i < fileSections.size() && isWritten; i++) {
+		const ModelCacheSection& section = fileSections[i];
+		size_t paddingSize = (size_t)(section.offset - position);
+		size_t dataSize = (size_t)(section.count * section.elementSize);
+		isWritten =
+			fwrite(padding, 1, paddingSize, file) == paddingSize &&
+			fwrite(sectionData[i], 1, dataSize, file) == dataSize;
+		position = section.offset + dataSize;
+	}
+	isWritten &= fclose(file) == 0;
+	// Don't leave a partial file behind, although it would be rejected anyway
+	if (!isWritten) remove(path.c_str());
+	return isWritten;
+}
+
+// ------------------------------------- //
+//               Cache Reader            //
+// ------------------------------------- //
+
+bool ModelCacheReader::open(const std::string& path, uint64_t key) {
+	if (!file.open(path.c_str())) return false;
+	const ModelCacheHeader* header = (const ModelCacheHeader*)file.getData();
+	if (file.getSize() < sizeof(ModelCacheHeader)
+		|| memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0
+		|| header->version != MODEL_CACHE_VERSION
+		|| header->key != key
+		|| header->fileSize != file.getSize()
+		|| sizeof(ModelCacheHeader) + (uint64_t)header->sectionNum * sizeof(ModelCacheSection) > file.getSize()) {
+		file.close();
+		return false;
+	}
+	sections = (const ModelCacheSection*)(file.getData() + sizeof(ModelCacheHeader));
+	sectionNum = header->sectionNum;
+	nextSection = 0;
+	return true;
+}
+
+const char* ModelCacheReader::readSection(uint64_t& count, uint32_t elementSize) {
+	if (nextSection >= sectionNum) return nullptr;
+	const ModelCacheSection& section = sections[nextSection++];
+	if (section.elementSize != elementSize) return nullptr;
+	if (section.offset > file.getSize() || section.count > (file.getSize() - section.offset) / elementSize) return nullptr;
+	count = section.count;
+	return file.getData() + section.offset;
+}
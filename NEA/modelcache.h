@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <string.h>
+#include "mappedfile.h"
+
+struct Transform;
+
+// A loaded model is cached in a binary file beside its OBJ file, holding its transformed mesh and
+// built hierarchy. Every array is one aligned block in exactly its in-memory layout, found through
+// a table of offsets, so loading a cached model takes a file mapping and one copy per array.
+// Bump the version whenever anything that is cached changes layout
+static constexpr uint32_t MODEL_CACHE_VERSION = 2;
+
+struct ModelCacheKey {
+	// Identifies the options a model was loaded with, and names its cache file
+	uint64_t optionsHash;
+	// Identifies the file content as well, and is checked against the cache file's
+	uint64_t key;
+};
+
+// Hash an OBJ file along with the options that affect what is cached, returning false if it can't be read
+bool calcModelCacheKey(
+	const std::string& objPath,
+	const Transform& transform,
+	int buildStrategy,
+	int bvhWidth,
+	size_t ingestMemoryLimit,
+	ModelCacheKey& cacheKey);
+std::string getModelCachePath(const std::string& objPath, const ModelCacheKey& cacheKey);
+
+struct ModelCacheSection {
+	// Distance of the section's first element from the start of the file
+	uint64_t offset;
+	uint64_t count;
+	uint32_t elementSize;
+	uint32_t padding;
+};
+
+// Collects arrays, then writes them out as a cache file in one go. The arrays aren't copied,
+// so must be left unchanged until the file is saved
+struct ModelCacheWriter {
+private:
+	std::vector<ModelCacheSection> sections;
+	std::vector<const void*> sectionData;
+	uint64_t bodySize = 0;
+
+	void writeSection(const void* data, uint64_t count, uint32_t elementSize);
+public:
+	template <typename T>
+	void writeArray(const std::vector<T>& array) {
+		writeSection(array.data(), array.size(), sizeof(T));
+	}
+	template <typename T>
+	void writeValue(const T& value) {
+		writeSection(&value, 1, sizeof(T));
+	}
+	bool save(const std::string& path, uint64_t key) const;
+};
+
+// Reads the arrays of a cache file back in the order they were written. Any mismatch with what
+// is being read, such as a different element size, fails the read rather than guessing
+struct ModelCacheReader {
+private:
+	MappedFile file;
+	const ModelCacheSection* sections = nullptr;
+	uint32_t sectionNum = 0;
+	uint32_t nextSection = 0;
+
+	const char* readSection(uint64_t& count, uint32_t elementSize);
+public:
+	// Fails if the file is missing, corrupt, from another version or made from other input
+	bool open(const std::string& path, uint64_t key);
+	template <typename T>
+	bool readArray(std::vector<T>& array) {
+		uint64_t count;
+		const char* data = readSection(count, sizeof(T));
+		if (data == nullptr) return false;
+		array.resize((size_t)count);
+		if (count > 0) memcpy((void*)array.data(), data, (size_t)count * sizeof(T));
+		return true;
+	}
+	template <typename T>
+	bool readValue(T& value) {
+		uint64_t count;
+		const char* data = readSection(count, sizeof(T));
+		if (data == nullptr || count != 1) return false;
+		memcpy((void*)&value, data, sizeof(T));
+		return true;
+	}
+};
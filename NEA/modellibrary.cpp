@@ -0,0 +1,40 @@
+#include "modellibrary.h"
+
+ModelLibrary::ModelLibrary(
+	Transform _transform,
+	BuildStrategies::BuildStrategy _strategy,
+	int _bvhWidth,
+	ThreadPool* _threadPool,
+	bool _useCache,
+	size_t _ingestMemoryLimit)
+	: transform(_transform), strategy(_strategy), bvhWidth(_bvhWidth),
+	threadPool(_threadPool), useCache(_useCache), ingestMemoryLimit(_ingestMemoryLimit) {
+}
+
+std::shared_ptr<Model> ModelLibrary::getModel(const std::string& filePath, bool isMirrored) {
+	ModelKey key = ModelKey(filePath, isMirrored);
+	auto iter = models.find(key);
+	if (iter != models.end()) return iter->second;
+	std::shared_ptr<Model> model = std::make_shared<Model>(
+		filePath, Vec3(), isMirrored ? transform.getMirrored() : transform,
+		strategy, bvhWidth, threadPool, useCache, ingestMemoryLimit);
+	models[key] = model;
+	return model;
+}
+
+Instance ModelLibrary::createInstance(const std::string& filePath, Vec3 position, Transform instanceTransform) {
+	if (!instanceTransform.flipsWinding()) {
+		return Instance(getModel(filePath), position, instanceTransform.getMatrix());
+	}
+	// The mirrored copy M is the library's transform L with a reflection, so is placed in the scene by
+	// the rotation R = T * M * L^-1 that takes it to where T * L would have placed the model. Both
+	// L and M are rotations and reflections, so L's inverse is its transpose
+	Mat3 libraryMatrix = transform.getMatrix();
+	Mat3 mirroredMatrix = transform.getMirrored().getMatrix();
+	Mat3 rotation = instanceTransform.getMatrix() * mirroredMatrix * libraryMatrix.getTranspose();
+	return Instance(getModel(filePath, true), position, rotation);
+}
+
+int ModelLibrary::getModelNum() const {
+	return models.size();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <memory>
+#include "instance.h"
+
+// Models loaded so far, each shared by every instance of its OBJ file, so that placing a file many
+// times only loads and builds it once. Every model is loaded with the same transform, and each
+// instance is then rotated and moved into place
+struct ModelLibrary {
+private:
+	// Instances that reflect their model share a second, mirrored, copy of it. Reflecting
+	// a model turns its triangles inside out, which a rotation of the ray can't undo
+	typedef std::pair<std::string, bool> ModelKey;
+	std::map<ModelKey, std::shared_ptr<Model>> models;
+
+	Transform transform;
+	BuildStrategies::BuildStrategy strategy;
+	int bvhWidth;
+	ThreadPool* threadPool;
+	bool useCache;
+	size_t ingestMemoryLimit;
+public:
+	// Arguments are passed on to each model as it is loaded
+	ModelLibrary(
+		Transform _transform = Transform(),
+		BuildStrategies::BuildStrategy _strategy = BuildStrategies::sah,
+		int _bvhWidth = 2,
+		ThreadPool* _threadPool = nullptr,
+		bool _useCache = false,
+		size_t _ingestMemoryLimit = 0);
+
+	// Get the model of an OBJ file, loading it the first time it is asked for
+	std::shared_ptr<Model> getModel(const std::string& filePath, bool isMirrored = false);
+	// Place an OBJ file's model in the scene, rotated and reflected by 'instanceTransform'
+	// after the library's own transform, and then moved to 'position'
+	Instance createInstance(const std::string& filePath, Vec3 position = Vec3(), Transform instanceTransform = Transform());
+	// Number of distinct models loaded, counting mirrored copies separately
+	int getModelNum() const;
+};
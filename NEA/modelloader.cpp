@@ -1,6 +1,339 @@
-#define _CRT_SECURE_NO_WARNINGS
-
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <algorithm>
 #include "modelloader.h"
+#include "mappedfile.h"
+#include "threadpool.h"
+#include "trianglefile.h"
+#include "model.h"
+
+// Files are only split into chunks when each chunk would be at least this large
+static constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+// Size of the buffer files are streamed through, which grows if a single line doesn't fit
+static constexpr size_t STREAM_BUFFER_SIZE = 4 << 20;
+// Chunks per thread, so that threads finishing early can take a share of the remaining work
+static constexpr int CHUNKS_PER_THREAD = 4;
+// Normal index of a triangle corner that wasn't given one
+static constexpr uint32_t NO_NORMAL = 0xFFFFFFFF;
+// Largest integer a double holds exactly, and the powers of ten that it holds exactly
+static constexpr uint64_t MAX_EXACT_MANTISSA = (uint64_t)1 << 53;
+static constexpr int MAX_EXACT_POWER = 22;
+static const double POWERS_OF_TEN[MAX_EXACT_POWER + 1] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+// Everything parsed from one chunk of a file. Relative (negative) indices can only be resolved once
+// the vertices and normals in earlier chunks are counted, so until then they are stored relative to
+// the chunk's first vertex or normal, and their positions are kept to be offset when merging
+struct OBJChunk {
+	std::vector<Vec3> vertices;
+	std::vector<Vec3> normals;
+	std::vector<uint32_t> vertexIndices;
+	std::vector<uint32_t> normalIndices;
+	std::vector<uint32_t> relativeVertexIndices;
+	std::vector<uint32_t> relativeNormalIndices;
+	int invalidLineNum = 0;
+};
+
+// A corner of a face, with its indices resolved as far as possible within its chunk
+struct FaceCorner {
+	uint32_t vertexIndex, normalIndex;
+	bool isVertexRelative, isNormalRelative;
+};
+
+// ------------------------------------ //
+//               Tokenising             //
+// ------------------------------------ //
+
+static bool isDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+// Whitespace within a line
+static bool isSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* skipSpaces(const char* p, const char* end) {
+	while (p < end && isSpace(*p)) p++;
+	return p;
+}
+
+// Returns the start of the next line
+static const char* skipLine(const char* p, const char* end) {
+	const char* newline = (const char*)memchr(p, '\n', end - p);
+	return newline == nullptr ? end : newline + 1;
+}
+
+// Whether a number or keyword ends at 'p', rather than running into other characters
+static bool isTokenEnd(const char* p, const char* end) {
+	return p == end || isSpace(*p) || *p == '\n';
+}
+
+// Parses decimal numbers, with optional fractions and exponents. The digits are gathered into an integer,
+// which is converted exactly when both it and its power of ten fit in a double. Anything longer or more
+// extreme, which exporters rarely write, is passed to the C library
+static bool parseFloat(const char*& p, const char* end, float& value) {
+	const char* start = p;
+	bool isNegative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		isNegative = *p == '-';
+		p++;
+	}
+	uint64_t mantissa = 0;
+	int exponent = 0;
+	int digitNum = 0;
+	// Leading zeros don't count towards the digits a mantissa can hold
+	int significantDigitNum = 0;
+	while (p < end && isDigit(*p)) {
+		if (significantDigitNum < 19) mantissa = mantissa * 10 + (*p - '0');
+		else exponent++;
+		if (mantissa != 0) significantDigitNum++;
+		digitNum++;
+		p++;
+	}
+	if (p < end && *p == '.') {
+		p++;
+		while (p < end && isDigit(*p)) {
+			if (significantDigitNum < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				exponent--;
+			}
+			if (mantissa != 0) significantDigitNum++;
+			digitNum++;
+			p++;
+		}
+	}
+	if (digitNum == 0) {
+		p = start;
+		return false;
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char* exponentStart = p;
+		p++;
+		bool isExponentNegative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			isExponentNegative = *p == '-';
+			p++;
+		}
+		if (p == end || !isDigit(*p)) {
+			// Not an exponent after all
+			p = exponentStart;
+		}
+		else {
+			int explicitExponent = 0;
+			while (p < end && isDigit(*p)) {
+				if (explicitExponent < 100000) explicitExponent = explicitExponent * 10 + (*p - '0');
+				p++;
+			}
+			exponent += isExponentNegative ? -explicitExponent : explicitExponent;
+		}
+	}
+	if (significantDigitNum <= 19 && mantissa <= MAX_EXACT_MANTISSA && exponent >= -MAX_EXACT_POWER && exponent <= MAX_EXACT_POWER) {
+		double result = (double)mantissa;
+		result = exponent < 0 ? result / POWERS_OF_TEN[-exponent] : result * POWERS_OF_TEN[exponent];
+		value = (float)(isNegative ? -result : result);
+		return true;
+	}
+	std::string number(start, p);
+	value = (float)strtod(number.c_str(), nullptr);
+	return true;
+}
+
+static bool parseIndex(const char*& p, const char* end, int64_t& index) {
+	bool isNegative = false;
+	if (p < end && *p == '-') {
+		isNegative = true;
+		p++;
+	}
+	if (p == end || !isDigit(*p)) return false;
+	index = 0;
+	while (p < end && isDigit(*p)) {
+		// Clamp absurd indices rather than overflowing, they are rejected later
+		if (index < 0xFFFFFFFFll) index = index * 10 + (*p - '0');
+		p++;
+	}
+	if (isNegative) index = -index;
+	return true;
+}
+
+static bool parseVec3(const char*& p, const char* end, Vec3& vector) {
+	p = skipSpaces(p, end);
+	if (!parseFloat(p, end, vector.x)) return false;
+	p = skipSpaces(p, end);
+	if (!parseFloat(p, end, vector.y)) return false;
+	p = skipSpaces(p, end);
+	return parseFloat(p, end, vector.z);
+}
+
+// ------------------------------------ //
+//                Parsing               //
+// ------------------------------------ //
+
+// Resolve an OBJ index, counted from one or backwards from the last element read, to one counted from zero
+static bool resolveIndex(int64_t index, size_t chunkElementNum, uint32_t& resolvedIndex, bool& isRelative) {
+	if (index == 0) return false;
+	isRelative = index < 0;
+	// Relative indices may refer to earlier chunks, so wrap around until the chunk's offset is added
+	resolvedIndex = isRelative ? (uint32_t)(chunkElementNum + index) : (uint32_t)(index - 1);
+	return true;
+}
+
+// Parse a face's 'v', 'v/vt', 'v//vn' or 'v/vt/vn' corners, ignoring texture coordinates
+static bool parseFace(const char*& p, const char* end, const OBJChunk& chunk, std::vector<FaceCorner>& corners) {
+	corners.clear();
+	while (true) {
+		p = skipSpaces(p, end);
+		if (p == end || *p == '\n' || *p == '#') break;
+		FaceCorner corner = { 0, NO_NORMAL, false, false };
+		int64_t index;
+		if (!parseIndex(p, end, index)) return false;
+		if (!resolveIndex(index, chunk.vertices.size(), corner.vertexIndex, corner.isVertexRelative)) return false;
+		if (p < end && *p == '/') {
+			p++;
+			if (p < end && *p != '/' && !isTokenEnd(p, end)) {
+				int64_t textureIndex;
+				if (!parseIndex(p, end, textureIndex)) return false;
+			}
+			if (p < end && *p == '/') {
+				p++;
+				if (!parseIndex(p, end, index)) return false;
+				if (!resolveIndex(index, chunk.normals.size(), corner.normalIndex, corner.isNormalRelative)) return false;
+			}
+		}
+		if (!isTokenEnd(p, end)) return false;
+		corners.push_back(corner);
+	}
+	return corners.size() >= 3;
+}
+
+static void addCorner(OBJChunk& chunk, const FaceCorner& corner) {
+	if (corner.isVertexRelative) chunk.relativeVertexIndices.push_back(chunk.vertexIndices.size());
+	if (corner.isNormalRelative) chunk.relativeNormalIndices.push_back(chunk.normalIndices.size());
+	chunk.vertexIndices.push_back(corner.vertexIndex);
+	chunk.normalIndices.push_back(corner.normalIndex);
+}
+
+static void parseChunk(const char* p, const char* end, const Transform& transform, OBJChunk& chunk) {
+	std::vector<FaceCorner> corners;
+	while (p < end) {
+		p = skipSpaces(p, end);
+		const char* lineStart = p;
+		bool isValid = true;
+		if (p + 1 < end && p[0] == 'v' && isSpace(p[1])) {
+			Vec3 vertex;
+			p++;
+			isValid = parseVec3(p, end, vertex);
+			if (isValid) chunk.vertices.push_back(transform.transform(vertex));
+		}
+		else if (p + 2 < end && p[0] == 'v' && p[1] == 'n' && isSpace(p[2])) {
+			Vec3 normal;
+			p += 2;
+			isValid = parseVec3(p, end, normal);
+			if (isValid) chunk.normals.push_back(transform.transform(normal));
+		}
+		else if (p + 1 < end && p[0] == 'f' && isSpace(p[1])) {
+			p++;
+			isValid = parseFace(p, end, chunk, corners);
+			if (isValid) {
+				// Triangulate the polygon as a fan around its first corner
+				for (int i = 1; i + 1 < corners.size(); i++) {
+					int v1Index = i;
+					int v2Index = i + 1;
+					transform.flipVertexIndices(v1Index, v2Index);
+					addCorner(chunk, corners[0]);
+					addCorner(chunk, corners[v1Index]);
+					addCorner(chunk, corners[v2Index]);
+				}
+			}
+		}
+		// Anything else, such as comments, groups, materials and texture coordinates, is skipped
+		if (!isValid) chunk.invalidLineNum++;
+		p = skipLine(lineStart, end);
+	}
+}
+
+// ------------------------------------ //
+//                Loading               //
+// ------------------------------------ //
+
+// Split a file into chunks that start at the beginnings of lines
+static std::vector<size_t> findChunkStarts(const char* data, size_t size, int chunkNum) {
+	std::vector<size_t> chunkStarts = { 0 };
+	for (int i = 1; i < chunkNum; i++) {
+		size_t start = std::max(chunkStarts.back(), (size_t)((uint64_t)size * i / chunkNum));
+		start = skipLine(data + start, data + size) - data;
+		chunkStarts.push_back(start);
+	}
+	chunkStarts.push_back(size);
+	return chunkStarts;
+}
+
+// Append a chunk to everything parsed before it, resolving its relative indices
+static void appendChunk(
+	const OBJChunk& chunk,
+	std::vector<Vec3>& vertices,
+	std::vector<Vec3>& normals,
+	std::vector<uint32_t>& vertexIndices,
+	std::vector<uint32_t>& normalIndices) {
+	size_t firstIndex = vertexIndices.size();
+	vertexIndices.insert(vertexIndices.end(), chunk.vertexIndices.begin(), chunk.vertexIndices.end());
+	normalIndices.insert(normalIndices.end(), chunk.normalIndices.begin(), chunk.normalIndices.end());
+	for (uint32_t index : chunk.relativeVertexIndices) {
+		vertexIndices[firstIndex + index] += vertices.size();
+	}
+	for (uint32_t index : chunk.relativeNormalIndices) {
+		normalIndices[firstIndex + index] += normals.size();
+	}
+	vertices.insert(vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+	normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+}
+
+// Give every triangle corner without a normal its triangle's flat normal, and drop triangles
+// with indices that are out of range, returning how many were dropped
+static int finishTriangles(
+	std::vector<Vec3>& vertices,
+	std::vector<Vec3>& normals,
+	std::vector<uint32_t>& vertexIndices,
+	std::vector<uint32_t>& normalIndices) {
+	uint32_t vertexNum = vertices.size();
+	uint32_t normalNum = normals.size();
+	size_t triangleNum = vertexIndices.size() / 3;
+	size_t validTriangleNum = 0;
+	for (size_t i = 0; i < triangleNum; i++) {
+		uint32_t* triangleVertices = &vertexIndices[i * 3];
+		uint32_t* triangleNormals = &normalIndices[i * 3];
+		bool isValid = true;
+		bool hasAllNormals = true;
+		for (int corner = 0; corner < 3; corner++) {
+			isValid &= triangleVertices[corner] < vertexNum;
+			if (triangleNormals[corner] == NO_NORMAL) hasAllNormals = false;
+			else isValid &= triangleNormals[corner] < normalNum;
+		}
+		if (!isValid) continue;
+		if (!hasAllNormals) {
+			// The vertices are already transformed, and in the transformed winding order
+			Vec3 v0 = vertices[triangleVertices[0]];
+			Vec3 normal = (vertices[triangleVertices[1]] - v0).cross(vertices[triangleVertices[2]] - v0);
+			// Degenerate triangles are never hit, so can keep a zero normal
+			if (normal.getLength() > 0.0f) normal = normal.normalise();
+			normals.push_back(normal);
+			for (int corner = 0; corner < 3; corner++) {
+				if (triangleNormals[corner] == NO_NORMAL) triangleNormals[corner] = normals.size() - 1;
+			}
+		}
+		for (int corner = 0; corner < 3; corner++) {
+			vertexIndices[validTriangleNum * 3 + corner] = triangleVertices[corner];
+			normalIndices[validTriangleNum * 3 + corner] = triangleNormals[corner];
+		}
+		validTriangleNum++;
+	}
+	vertexIndices.resize(validTriangleNum * 3);
+	normalIndices.resize(validTriangleNum * 3);
+	return triangleNum - validTriangleNum;
+}
 
 bool loadOBJ(
 	const char* path,
@@ -8,94 +341,112 @@ bool loadOBJ(
 	std::vector<Vec3>& outNormals,
 	std::vector<uint32_t>& outVertexIndices,
 	std::vector<uint32_t>& outNormalIndices,
-	const Transform& transform
+	const Transform& transform,
+	ThreadPool* threadPool
 ) {
-	FILE* file = fopen(path, "r");
-	if (file == nullptr) {
+	MappedFile file;
+	if (!file.open(path)) {
 		printf("Impossible to open OBJ file!\n");
-		printf(path);
-		printf("\n");
+		printf("%s\n", path);
 		return false;
 	}
-	parseOBJ(file,
-		outVertexIndices, outNormalIndices,
-		outVertices, outNormals, transform);
-	return true;
-}
+	const char* data = file.getData();
+	size_t size = file.getSize();
 
-static void parseVertex(
-	FILE* file,
-	std::vector<Vec3>& tempVertices,
-	const Transform& transform
-) {
-	Vec3 vertex;
-	fscanf_s(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-	tempVertices.push_back(transform.transform(vertex));
-}
+	int chunkNum = 1;
+	if (threadPool != nullptr && threadPool->getThreadNum() > 1) {
+		chunkNum = (int)std::max((size_t)1, std::min((size_t)(threadPool->getThreadNum() * CHUNKS_PER_THREAD), size / MIN_CHUNK_SIZE));
+	}
+	std::vector<size_t> chunkStarts = findChunkStarts(data, size, chunkNum);
+	std::vector<OBJChunk> chunks(chunkNum);
+	auto parse = [&](int i) {
+		parseChunk(data + chunkStarts[i], data + chunkStarts[i + 1], transform, chunks[i]);
+	};
+	if (chunkNum > 1) threadPool->parallelFor(chunkNum, parse);
+	else parse(0);
 
-static void parseNormal(
-	FILE* file,
-	std::vector<Vec3>& tempNormals,
-	const Transform& transform
-) {
-	Vec3 normal;
-	fscanf_s(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
-	tempNormals.push_back(transform.transform(normal));
+	// Concatenate the chunks
+	size_t vertexNum = 0, normalNum = 0, indexNum = 0;
+	int invalidLineNum = 0;
+	for (const OBJChunk& chunk : chunks) {
+		vertexNum += chunk.vertices.size();
+		normalNum += chunk.normals.size();
+		indexNum += chunk.vertexIndices.size();
+		invalidLineNum += chunk.invalidLineNum;
+	}
+	outVertices.clear();
+	outNormals.clear();
+	outVertexIndices.clear();
+	outNormalIndices.clear();
+	outVertices.reserve(vertexNum);
+	outNormals.reserve(normalNum);
+	outVertexIndices.reserve(indexNum);
+	outNormalIndices.reserve(indexNum);
+	for (OBJChunk& chunk : chunks) {
+		appendChunk(chunk, outVertices, outNormals, outVertexIndices, outNormalIndices);
+		// Free each chunk once it's copied, so that the file's geometry is only held twice at once briefly
+		chunk = OBJChunk();
+	}
+	int invalidTriangleNum = finishTriangles(outVertices, outNormals, outVertexIndices, outNormalIndices);
+	if (invalidLineNum > 0 || invalidTriangleNum > 0) {
+		printf("Skipped %d unreadable lines and %d triangles with missing vertices in %s\n", invalidLineNum, invalidTriangleNum, path);
+	}
+	return true;
 }
 
-static void parseFace(
-	FILE* file,
-	std::vector<unsigned int>& vertexIndices,
-	std::vector<unsigned int>& normalIndices,
-	const Transform& transform
-) {
-	std::string vertex1, vertex2, vertex3;
-	unsigned int vertexIndex[3], normalIndex[3];
-	int matches = fscanf_s(
-		file, "%d//%d %d//%d %d//%d\n",
-		&vertexIndex[0], &normalIndex[0],
-		&vertexIndex[1], &normalIndex[1],
-		&vertexIndex[2], &normalIndex[2]);
-	if (matches != 6) {
-		printf("File can't be read, try exporting with other options\n");
-		return;
-	}
-	int v0IndexIndex = 0;
-	int v1IndexIndex = 1;
-	int v2IndexIndex = 2;
-		transform.flipVertexIndices(
-		v1IndexIndex,
-		v2IndexIndex);
-
-	vertexIndices.push_back(vertexIndex[v0IndexIndex]);
-	vertexIndices.push_back(vertexIndex[v1IndexIndex]);
-	vertexIndices.push_back(vertexIndex[v2IndexIndex]);
-	normalIndices.push_back(normalIndex[0]);
-	normalIndices.push_back(normalIndex[1]);
-	normalIndices.push_back(normalIndex[2]);
-}
-
-static void parseOBJ(
-	FILE* file,
-	std::vector<unsigned int>& vertexIndices,
-	std::vector<unsigned int>& normalIndices,
-	std::vector<Vec3>& tempVertices,
-	std::vector<Vec3>& tempNormals,
+bool streamOBJ(
+	const char* path,
+	std::vector<Vec3>& outVertices,
+	std::vector<Vec3>& outNormals,
+	TriangleFile& triangleFile,
 	const Transform& transform
 ) {
-	while (true) {
-		char lineHeader[128];
-		int res = fscanf(file, "%s", lineHeader);
-		if (res == EOF) break;
-
-		if (strcmp(lineHeader, "v") == 0) {
-			parseVertex(file, tempVertices, transform);
-		}
-		else if (strcmp(lineHeader, "vn") == 0) {
-			parseNormal(file, tempNormals, transform);
+	FILE* file = fopen(path, "rb");
+	if (file == nullptr) {
+		printf("Impossible to open OBJ file!\n");
+		printf("%s\n", path);
+		return false;
+	}
+	outVertices.clear();
+	outNormals.clear();
+	std::vector<char> buffer(STREAM_BUFFER_SIZE);
+	size_t bufferSize = 0;
+	std::vector<uint32_t> vertexIndices, normalIndices;
+	std::vector<Triangle> triangles;
+	uint32_t triangleNum = 0;
+	int invalidLineNum = 0, invalidTriangleNum = 0;
+	bool isEnd = false;
+	while (!isEnd) {
+		bufferSize += fread(buffer.data() + bufferSize, 1, buffer.size() - bufferSize, file);
+		isEnd = bufferSize < buffer.size();
+		// Parse up to the last whole line, keeping the rest for the next batch
+		size_t parseSize = bufferSize;
+		if (!isEnd) {
+			while (parseSize > 0 && buffer[parseSize - 1] != '\n') parseSize--;
+			if (parseSize == 0) {
+				buffer.resize(buffer.size() * 2);
+				continue;
+			}
 		}
-		else if (strcmp(lineHeader, "f") == 0) {
-			parseFace(file, vertexIndices, normalIndices, transform);
+		OBJChunk chunk;
+		parseChunk(buffer.data(), buffer.data() + parseSize, transform, chunk);
+		invalidLineNum += chunk.invalidLineNum;
+		// Faces can only refer to vertices and normals before them, which are all known by now
+		vertexIndices.clear();
+		normalIndices.clear();
+		appendChunk(chunk, outVertices, outNormals, vertexIndices, normalIndices);
+		invalidTriangleNum += finishTriangles(outVertices, outNormals, vertexIndices, normalIndices);
+		triangles.clear();
+		for (size_t i = 0; i < vertexIndices.size(); i += 3) {
+			triangles.push_back(Triangle(vertexIndices[i], vertexIndices[i + 1], vertexIndices[i + 2], normalIndices[i], triangleNum++));
 		}
+		triangleFile.write(triangles);
+		memmove(buffer.data(), buffer.data() + parseSize, bufferSize - parseSize);
+		bufferSize -= parseSize;
 	}
+	fclose(file);
+	if (invalidLineNum > 0 || invalidTriangleNum > 0) {
+		printf("Skipped %d unreadable lines and %d triangles with missing vertices in %s\n", invalidLineNum, invalidTriangleNum, path);
+	}
+	return true;
 }
@@ -1,34 +1,30 @@
 #pragma once
 
 #include <vector>
+#include <stdint.h>
 #include "transform.h"
 
+struct ThreadPool;
+struct TriangleFile;
+
+// Load the vertices and normals of a Wavefront OBJ file, transformed, and its faces as triangles.
+// Each triangle has three vertex indices and three normal indices, counted from zero. Polygons
+// are split into fans of triangles, and faces given without normals are given flat ones.
+// Large files are split into chunks of lines, which are parsed in parallel on the thread pool
 bool loadOBJ(
 	const char* path,
 	std::vector<Vec3>& outVertices,
 	std::vector<Vec3>& outNormals,
 	std::vector<uint32_t>& outVertexIndices,
 	std::vector<uint32_t>& outNormalIndices,
-	const Transform& transform);
-
-static void parseVertex(
-	FILE* file,
-	std::vector<Vec3>& tempVertices,
-	const Transform& transform);
-
-static void parseNormal(
-	FILE* file,
-	std::vector<Vec3>& tempNormals,
-	const Transform& transform);
+	const Transform& transform,
+	ThreadPool* threadPool = nullptr);
 
-static void parseFace(FILE* file,
-	std::vector<uint32_t>& vertexIndices,
-	std::vector<uint32_t>& normalIndices,
+// Load an OBJ file the same way, but stream it through a fixed-size buffer and write its triangles
+// to 'triangleFile' a batch at a time, so that only its vertices and normals are held in memory
+bool streamOBJ(
+	const char* path,
+	std::vector<Vec3>& outVertices,
+	std::vector<Vec3>& outNormals,
+	TriangleFile& triangleFile,
 	const Transform& transform);
-
-static void parseOBJ(FILE* file,
-	std::vector<uint32_t>& vertexIndices,
-	std::vector<uint32_t>& normalIndices,
-	std::vector<Vec3>& tempVertices,
-	std::vector<Vec3>& tempNormals,
-	const Transform& transform);
\ No newline at end of file
@@ -0,0 +1,206 @@
+#include <math.h>
+#include <algorithm>
+#include "postprocess.h"
+#include "threadpool.h"
+
+// Every kernel does the same operations in the same order, without fusing multiplies and adds, so each
+// gives bit-identical output. Negative and NaN components are shown as black, and infinite ones as white
+
+// Entries in the gamma table. Indexing by the square root of the tone-mapped value makes neighbouring
+// entries less than a tenth of an output level apart, so no interpolation is needed
+static constexpr int GAMMA_TABLE_SIZE = 4096;
+// Rows processed by each task when running on a thread pool
+static constexpr int ROWS_PER_TASK = 16;
+// Size of the square ordered dither pattern, and its thresholds, in the order pixels cross them
+static constexpr int DITHER_SIZE = 4;
+static const int BAYER_MATRIX[DITHER_SIZE][DITHER_SIZE] = {
+	{ 0, 8, 2, 10 },
+	{ 12, 4, 14, 6 },
+	{ 3, 11, 1, 9 },
+	{ 15, 7, 13, 5 }
+};
+
+static_assert(sizeof(Vec3) == 3 * sizeof(float), "Framebuffer rows are processed as plain arrays of floats");
+
+struct RowParameters {
+	float exposure;
+	bool isReinhard;
+	const float* gammaTable;
+};
+
+static uint8_t processComponent(float value, float dither, const RowParameters& parameters) {
+	float scaled = value * parameters.exposure;
+	scaled = scaled > 0.0f ? scaled : 0.0f;
+	float mapped = parameters.isReinhard ? scaled / (scaled + 1.0f) : scaled;
+	mapped = mapped < 1.0f ? mapped : 1.0f;
+	int index = (int)(sqrtf(mapped) * (float)(GAMMA_TABLE_SIZE - 1) + 0.5f);
+	// Rounded to the nearest level, and capped at white, which dithering could otherwise go past
+	float level = parameters.gammaTable[index] + dither + 0.5f;
+	return (uint8_t)(int)(level < 255.5f ? level : 255.5f);
+}
+
+// Process 'count' consecutive colour components, with 'dither' holding an offset for each, or null for none
+static void processComponentsScalar(const float* in, int count, const float* dither, const RowParameters& parameters, uint8_t* out) {
+	for (int i = 0; i < count; i++) {
+		out[i] = processComponent(in[i], dither != nullptr ? dither[i] : 0.0f, parameters);
+	}
+}
+
+#if SIMD_X86
+
+// ------------------------------ //
+//               SSE              //
+// ------------------------------ //
+
+static void processComponentsSSE(const float* in, int count, const float* dither, const RowParameters& parameters, uint8_t* out) {
+	const __m128 exposure = _mm_set1_ps(parameters.exposure);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 white = _mm_set1_ps(255.5f);
+	const __m128 tableScale = _mm_set1_ps((float)(GAMMA_TABLE_SIZE - 1));
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		// Maximum and minimum return their second operand for NaN, turning NaN black as the scalar code does
+		__m128 scaled = _mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), exposure), zero);
+		__m128 mapped = parameters.isReinhard ? _mm_div_ps(scaled, _mm_add_ps(scaled, one)) : scaled;
+		mapped = _mm_min_ps(mapped, one);
+		__m128i indices = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_sqrt_ps(mapped), tableScale), half));
+		// There's no gather instruction before AVX2, so the table is read one entry at a time
+		alignas(16) int indexArray[4];
+		_mm_store_si128((__m128i*)indexArray, indices);
+		const float* table = parameters.gammaTable;
+		__m128 level = _mm_setr_ps(table[indexArray[0]], table[indexArray[1]], table[indexArray[2]], table[indexArray[3]]);
+		if (dither != nullptr) level = _mm_add_ps(level, _mm_loadu_ps(dither + i));
+		level = _mm_min_ps(_mm_add_ps(level, half), white);
+		// Narrow the four levels to bytes, and store them together
+		__m128i levels = _mm_cvttps_epi32(level);
+		levels = _mm_packus_epi16(_mm_packs_epi32(levels, levels), levels);
+		int packed = _mm_cvtsi128_si32(levels);
+		std::copy((const uint8_t*)&packed, (const uint8_t*)&packed + 4, out + i);
+	}
+	processComponentsScalar(in + i, count - i, dither != nullptr ? dither + i : nullptr, parameters, out + i);
+}
+
+// ------------------------------- //
+//               AVX2              //
+// ------------------------------- //
+
+TARGET_AVX2
+static void processComponentsAVX2(const float* in, int count, const float* dither, const RowParameters& parameters, uint8_t* out) {
+	const __m256 exposure = _mm256_set1_ps(parameters.exposure);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 white = _mm256_set1_ps(255.5f);
+	const __m256 tableScale = _mm256_set1_ps((float)(GAMMA_TABLE_SIZE - 1));
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 scaled = _mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), exposure), zero);
+		__m256 mapped = parameters.isReinhard ? _mm256_div_ps(scaled, _mm256_add_ps(scaled, one)) : scaled;
+		mapped = _mm256_min_ps(mapped, one);
+		__m256i indices = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_sqrt_ps(mapped), tableScale), half));
+		__m256 level = _mm256_i32gather_ps(parameters.gammaTable, indices, 4);
+		if (dither != nullptr) level = _mm256_add_ps(level, _mm256_loadu_ps(dither + i));
+		level = _mm256_min_ps(_mm256_add_ps(level, half), white);
+		// Narrow each half of the eight levels to bytes, as packing across the two halves would interleave them
+		__m256i levels = _mm256_cvttps_epi32(level);
+		__m128i low = _mm256_castsi256_si128(levels);
+		__m128i high = _mm256_extracti128_si256(levels, 1);
+		__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(low, high), _mm_setzero_si128());
+		_mm_storel_epi64((__m128i*)(out + i), bytes);
+	}
+	processComponentsScalar(in + i, count - i, dither != nullptr ? dither + i : nullptr, parameters, out + i);
+}
+
+#endif
+
+// ------------------------------------- //
+//               PostProcess             //
+// ------------------------------------- //
+
+PostProcess::PostProcess(float _exposure, ToneCurves::ToneCurve _toneCurve, float _gamma, bool _isDithered)
+	: exposure(_exposure), toneCurve(_toneCurve), gamma(_gamma), isDithered(_isDithered), simdLevel(getSupportedSIMDLevel()) {
+	buildGammaTable();
+}
+
+void PostProcess::buildGammaTable() {
+	gammaTable.resize(GAMMA_TABLE_SIZE);
+	for (int i = 0; i < GAMMA_TABLE_SIZE; i++) {
+		// Entry i holds the level for a tone-mapped value whose square root is i / (size - 1)
+		float root = i / (float)(GAMMA_TABLE_SIZE - 1);
+		gammaTable[i] = pow(root * root, 1.0f / gamma) * 255.0f;
+	}
+}
+
+void PostProcess::apply(const Framebuffer& framebuffer, std::vector<uint8_t>& out, ThreadPool* threadPool) const {
+	int width = framebuffer.getWidth();
+	int height = framebuffer.getHeight();
+	out.resize((size_t)width * height * 3);
+	// Offsets for each component of a row, in the range [-0.5, 0.5), from the row of the pattern it falls on
+	int componentNum = width * 3;
+	std::vector<float> dither;
+	if (isDithered) dither.resize(componentNum * DITHER_SIZE);
+	for (int patternY = 0; isDithered && patternY < DITHER_SIZE; patternY++) {
+		for (int i = 0; i < componentNum; i++) {
+			int threshold = BAYER_MATRIX[patternY][(i / 3) % DITHER_SIZE];
+			dither[patternY * componentNum + i] = (threshold + 0.5f) / (DITHER_SIZE * DITHER_SIZE) - 0.5f;
+		}
+	}
+	if (threadPool == nullptr || threadPool->getThreadNum() <= 1) {
+		processRows(framebuffer, 0, height, dither, out.data());
+		return;
+	}
+	// Each task writes its own rows of the output, so the tasks can share it
+	int taskNum = (height + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+	threadPool->parallelFor(taskNum, [&](int taskIndex) {
+		int startY = taskIndex * ROWS_PER_TASK;
+		processRows(framebuffer, startY, std::min(startY + ROWS_PER_TASK, height), dither, out.data());
+	});
+}
+
+void PostProcess::processRows(const Framebuffer& framebuffer, int startY, int endY, const std::vector<float>& dither, uint8_t* out) const {
+	int componentNum = framebuffer.getWidth() * 3;
+	RowParameters parameters = { exposure, toneCurve == ToneCurves::reinhard, gammaTable.data() };
+	for (int y = startY; y < endY; y++) {
+		const float* in = &framebuffer.getRow(y)->x;
+		const float* rowDither = dither.empty() ? nullptr : &dither[(y % DITHER_SIZE) * componentNum];
+		uint8_t* rowOut = out + (size_t)y * componentNum;
+#if SIMD_X86
+		if (simdLevel >= SIMDLevels::avx2) {
+			processComponentsAVX2(in, componentNum, rowDither, parameters, rowOut);
+			continue;
+		}
+		if (simdLevel >= SIMDLevels::sse) {
+			processComponentsSSE(in, componentNum, rowDither, parameters, rowOut);
+			continue;
+		}
+#endif
+		processComponentsScalar(in, componentNum, rowDither, parameters, rowOut);
+	}
+}
+
+void PostProcess::setExposure(float _exposure) {
+	exposure = _exposure;
+}
+
+float PostProcess::getExposure() const {
+	return exposure;
+}
+
+void PostProcess::setToneCurve(ToneCurves::ToneCurve _toneCurve) {
+	toneCurve = _toneCurve;
+}
+
+void PostProcess::setGamma(float _gamma) {
+	gamma = _gamma;
+	buildGammaTable();
+}
+
+void PostProcess::setDithered(bool _isDithered) {
+	isDithered = _isDithered;
+}
+
+void PostProcess::setSIMDLevel(SIMDLevels::SIMDLevel level) {
+	simdLevel = std::min(level, getSupportedSIMDLevel());
+}
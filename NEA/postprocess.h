@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "framebuffer.h"
+#include "simd.h"
+
+struct ThreadPool;
+
+namespace ToneCurves {
+	enum ToneCurve {
+		reinhard, // x / (x + 1), which brings any brightness into the displayable range
+		clamp     // Colours are shown as they are, with anything brighter than one clipped
+	};
+}
+
+// Turns a framebuffer's linear HDR colours into 8-bit colours for display, as a separate pass over the
+// whole image after it has been traced. Each colour component is scaled by the exposure, tone mapped,
+// gamma corrected through a lookup table, and optionally dithered, several at a time with SIMD and
+// with rows split between the threads of a thread pool. As the framebuffer is left unchanged, the
+// settings can be changed and the image processed again without tracing any rays
+struct PostProcess {
+private:
+	float exposure;
+	ToneCurves::ToneCurve toneCurve;
+	float gamma;
+	bool isDithered;
+	SIMDLevels::SIMDLevel simdLevel;
+	// Gamma-corrected output levels, from 0 to 255, indexed by the square root of the tone-mapped
+	// value, which spreads the entries out where the gamma curve is steepest, near black
+	std::vector<float> gammaTable;
+
+	void buildGammaTable();
+	// Process the rows of an image from 'startY' up to, but not including, 'endY'. 'dither' holds
+	// each row of the dither pattern, as an offset for every component of a row, or is empty
+	void processRows(const Framebuffer& framebuffer, int startY, int endY, const std::vector<float>& dither, uint8_t* out) const;
+public:
+	PostProcess(
+		float _exposure = 1.0f,
+		ToneCurves::ToneCurve _toneCurve = ToneCurves::reinhard,
+		float _gamma = 2.2f,
+		bool _isDithered = false);
+
+	// Tone map the framebuffer into tightly packed 8-bit RGB triples, on the thread pool if one is given
+	void apply(const Framebuffer& framebuffer, std::vector<uint8_t>& out, ThreadPool* threadPool = nullptr) const;
+
+	// Multiplier applied to every colour before tone mapping, where each doubling is one stop brighter
+	void setExposure(float _exposure);
+	float getExposure() const;
+	void setToneCurve(ToneCurves::ToneCurve _toneCurve);
+	void setGamma(float _gamma);
+	// Whether each component is offset by an ordered dither pattern before rounding, hiding banding in smooth gradients
+	void setDithered(bool _isDithered);
+	// Use the given instruction set, or the widest the CPU supports below it
+	void setSIMDLevel(SIMDLevels::SIMDLevel level);
+};
@@ -0,0 +1,230 @@
+#include "raypacket.h"
+#include "BVH.h"
+
+static constexpr int GROUP_MASK = (1 << RayPacket::groupSize) - 1;
+
+RayPacket::RayPacket(const Vec3& _origin)
+	: origin(_origin), rayNum(0) {
+}
+
+void RayPacket::addRay(const Ray& ray, float tMax) {
+	Vec3 direction = ray.getDirection();
+	Vec3 invDirection = ray.getInvDirection();
+	// Unused rays are still tested alongside the others in their group, so
+	// the first ray of each group is copied over the rest until they are added
+	int end = rayNum % groupSize == 0 ? rayNum + groupSize : rayNum + 1;
+	for (int i = rayNum; i < end; i++) {
+		dirX[i] = direction.x;
+		dirY[i] = direction.y;
+		dirZ[i] = direction.z;
+		invDirX[i] = invDirection.x;
+		invDirY[i] = invDirection.y;
+		invDirZ[i] = invDirection.z;
+		t[i] = tMax;
+		triangleIndices[i] = -1;
+		instanceIndices[i] = -1;
+	}
+	rayNum++;
+}
+
+uint64_t RayPacket::getRayMask() const {
+	return rayNum == maxRayNum ? ~(uint64_t)0 : ((uint64_t)1 << rayNum) - 1;
+}
+
+Vec3 RayPacket::getDirection(int index) const {
+	return Vec3(dirX[index], dirY[index], dirZ[index]);
+}
+
+Vec3 RayPacket::getInvDirection(int index) const {
+	return Vec3(invDirX[index], invDirY[index], invDirZ[index]);
+}
+
+int countRays(uint64_t rayMask) {
+	int rayNum = 0;
+	for (; rayMask != 0; rayMask &= rayMask - 1) {
+		rayNum++;
+	}
+	return rayNum;
+}
+
+// ------------------------------- //
+//             Scalar              //
+// ------------------------------- //
+
+static int rayGroupBoxIntersectionScalar(const AABB& box, const Vec3& origin, const RayPacket& packet, int group, int groupMask, float* tEntries) {
+	int hitMask = 0;
+	for (int i = 0; i < RayPacket::groupSize; i++) {
+		int ray = group * RayPacket::groupSize + i;
+		if ((groupMask & (1 << i)) && box.rayIntersection(origin, packet.getInvDirection(ray), packet.t[ray], tEntries[ray])) {
+			hitMask |= 1 << i;
+		}
+	}
+	return hitMask;
+}
+
+static int rayGroupTrianglesIntersectionScalar(
+	const TriangleArrays& triangles,
+	uint32_t first,
+	uint32_t triangleNum,
+	const Vec3& origin,
+	RayPacket& packet,
+	int group,
+	int groupMask) {
+	int hitMask = 0;
+	for (int i = 0; i < RayPacket::groupSize; i++) {
+		int ray = group * RayPacket::groupSize + i;
+		if (!(groupMask & (1 << i))) continue;
+		for (uint32_t index = first; index < first + triangleNum; index++) {
+			float dist;
+			if (rayTrianglesIntersectionScalar(triangles, index, 1, origin, packet.getDirection(ray), &dist) && dist < packet.t[ray]) {
+				packet.t[ray] = dist;
+				packet.triangleIndices[ray] = triangles.triangleIndices[index];
+				hitMask |= 1 << i;
+			}
+		}
+	}
+	return hitMask;
+}
+
+#if SIMD_X86
+
+// ------------------------------- //
+//               SSE               //
+// ------------------------------- //
+
+// Both tests do the same operations in the same order as their single ray versions, so that
+// every ray in a packet finds exactly the same hit as it would if traced on its own
+
+static int rayGroupBoxIntersectionSSE(const AABB& box, const Vec3& origin, const RayPacket& packet, int group, int groupMask, float* tEntries) {
+	int first = group * RayPacket::groupSize;
+	// Each ray only differs in direction, so the distances to the box's planes are shared
+	const Vec3 minOffset = box.min - origin;
+	const Vec3 maxOffset = box.max - origin;
+	const __m128 invDirX = _mm_loadu_ps(&packet.invDirX[first]);
+	const __m128 invDirY = _mm_loadu_ps(&packet.invDirY[first]);
+	const __m128 invDirZ = _mm_loadu_ps(&packet.invDirZ[first]);
+	__m128 t0x = _mm_mul_ps(_mm_set1_ps(minOffset.x), invDirX);
+	__m128 t0y = _mm_mul_ps(_mm_set1_ps(minOffset.y), invDirY);
+	__m128 t0z = _mm_mul_ps(_mm_set1_ps(minOffset.z), invDirZ);
+	__m128 t1x = _mm_mul_ps(_mm_set1_ps(maxOffset.x), invDirX);
+	__m128 t1y = _mm_mul_ps(_mm_set1_ps(maxOffset.y), invDirY);
+	__m128 t1z = _mm_mul_ps(_mm_set1_ps(maxOffset.z), invDirZ);
+	// Operands are swapped to match std::min and std::max with NaNs, as in the wide BVH's test
+	__m128 tNear = _mm_max_ps(_mm_min_ps(t1z, t0z), _mm_max_ps(_mm_min_ps(t1y, t0y), _mm_min_ps(t1x, t0x)));
+	__m128 tFar = _mm_min_ps(_mm_max_ps(t1z, t0z), _mm_min_ps(_mm_max_ps(t1y, t0y), _mm_max_ps(t1x, t0x)));
+	__m128 hit = _mm_and_ps(
+		_mm_and_ps(_mm_cmple_ps(tNear, tFar), _mm_cmpge_ps(tFar, _mm_setzero_ps())),
+		_mm_cmplt_ps(tNear, _mm_loadu_ps(&packet.t[first])));
+	_mm_storeu_ps(&tEntries[first], tNear);
+	return _mm_movemask_ps(hit) & groupMask;
+}
+
+static int rayGroupTrianglesIntersectionSSE(
+	const TriangleArrays& triangles,
+	uint32_t first,
+	uint32_t triangleNum,
+	const Vec3& origin,
+	RayPacket& packet,
+	int group,
+	int groupMask) {
+	int firstRay = group * RayPacket::groupSize;
+	const __m128 dirX = _mm_loadu_ps(&packet.dirX[firstRay]);
+	const __m128 dirY = _mm_loadu_ps(&packet.dirY[firstRay]);
+	const __m128 dirZ = _mm_loadu_ps(&packet.dirZ[firstRay]);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	// Expand the bits of the group's mask to whole lanes
+	const __m128 rayMask = _mm_castsi128_ps(_mm_cmpgt_epi32(
+		_mm_and_si128(_mm_set1_epi32(groupMask), _mm_setr_epi32(1, 2, 4, 8)), _mm_setzero_si128()));
+	__m128 closestT = _mm_loadu_ps(&packet.t[firstRay]);
+	__m128i closestIndices = _mm_loadu_si128((const __m128i*)&packet.triangleIndices[firstRay]);
+	int hitMask = 0;
+	for (uint32_t index = first; index < first + triangleNum; index++) {
+		Vec3 v0 = Vec3(triangles.v0x[index], triangles.v0y[index], triangles.v0z[index]);
+		Vec3 edge0 = Vec3(triangles.edge0x[index], triangles.edge0y[index], triangles.edge0z[index]);
+		Vec3 edge1 = Vec3(triangles.edge1x[index], triangles.edge1y[index], triangles.edge1z[index]);
+		// The parts of the test that don't depend on the ray direction are the same for every ray
+		Vec3 tvec = origin - v0;
+		Vec3 qvec = tvec.cross(edge0);
+		float qDotEdge1 = edge1.dot(qvec);
+
+		// pvec = rayDirection x edge1
+		__m128 pvecX = _mm_sub_ps(_mm_mul_ps(dirY, _mm_set1_ps(edge1.z)), _mm_mul_ps(dirZ, _mm_set1_ps(edge1.y)));
+		__m128 pvecY = _mm_sub_ps(_mm_mul_ps(dirZ, _mm_set1_ps(edge1.x)), _mm_mul_ps(dirX, _mm_set1_ps(edge1.z)));
+		__m128 pvecZ = _mm_sub_ps(_mm_mul_ps(dirX, _mm_set1_ps(edge1.y)), _mm_mul_ps(dirY, _mm_set1_ps(edge1.x)));
+		__m128 det = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_set1_ps(edge0.x), pvecX), _mm_mul_ps(_mm_set1_ps(edge0.y), pvecY)), _mm_mul_ps(_mm_set1_ps(edge0.z), pvecZ));
+		__m128 invDet = _mm_div_ps(one, det);
+		__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_set1_ps(tvec.x), pvecX), _mm_mul_ps(_mm_set1_ps(tvec.y), pvecY)), _mm_mul_ps(_mm_set1_ps(tvec.z), pvecZ)), invDet);
+		__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(dirX, _mm_set1_ps(qvec.x)), _mm_mul_ps(dirY, _mm_set1_ps(qvec.y))), _mm_mul_ps(dirZ, _mm_set1_ps(qvec.z))), invDet);
+		__m128 t = _mm_mul_ps(_mm_set1_ps(qDotEdge1), invDet);
+
+		__m128 miss = _mm_cmple_ps(det, _mm_set1_ps(MIN_DETERMINANT));
+		miss = _mm_or_ps(miss, _mm_or_ps(_mm_cmplt_ps(u, zero), _mm_cmpgt_ps(u, one)));
+		miss = _mm_or_ps(miss, _mm_or_ps(_mm_cmplt_ps(v, zero), _mm_cmpgt_ps(_mm_add_ps(u, v), one)));
+		__m128 hit = _mm_andnot_ps(miss, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, closestT)));
+		hit = _mm_and_ps(hit, rayMask);
+		if (_mm_movemask_ps(hit) == 0) continue;
+		hitMask |= _mm_movemask_ps(hit);
+		closestT = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, closestT));
+		__m128i hitIndices = _mm_castps_si128(hit);
+		closestIndices = _mm_or_si128(
+			_mm_and_si128(hitIndices, _mm_set1_epi32(triangles.triangleIndices[index])),
+			_mm_andnot_si128(hitIndices, closestIndices));
+	}
+	_mm_storeu_ps(&packet.t[firstRay], closestT);
+	_mm_storeu_si128((__m128i*)&packet.triangleIndices[firstRay], closestIndices);
+	return hitMask;
+}
+
+#endif
+
+uint64_t rayPacketBoxIntersection(const AABB& box, const Vec3& origin, const RayPacket& packet, uint64_t rayMask, float* tEntries) {
+	uint64_t hitMask = 0;
+	int groupNum = (packet.rayNum + RayPacket::groupSize - 1) / RayPacket::groupSize;
+	for (int group = 0; group < groupNum; group++) {
+		int groupMask = (int)(rayMask >> (group * RayPacket::groupSize)) & GROUP_MASK;
+		if (groupMask == 0) continue;
+		int groupHitMask;
+#if SIMD_X86
+		if (BVH::getSIMDLevel() >= SIMDLevels::sse) {
+			groupHitMask = rayGroupBoxIntersectionSSE(box, origin, packet, group, groupMask, tEntries);
+		}
+		else
+#endif
+		{
+			groupHitMask = rayGroupBoxIntersectionScalar(box, origin, packet, group, groupMask, tEntries);
+		}
+		hitMask |= (uint64_t)groupHitMask << (group * RayPacket::groupSize);
+	}
+	return hitMask;
+}
+
+uint64_t rayPacketTrianglesIntersection(
+	const TriangleArrays& triangles,
+	uint32_t first,
+	uint32_t triangleNum,
+	const Vec3& origin,
+	RayPacket& packet,
+	uint64_t rayMask) {
+	uint64_t hitMask = 0;
+	int groupNum = (packet.rayNum + RayPacket::groupSize - 1) / RayPacket::groupSize;
+	for (int group = 0; group < groupNum; group++) {
+		int groupMask = (int)(rayMask >> (group * RayPacket::groupSize)) & GROUP_MASK;
+		if (groupMask == 0) continue;
+		int groupHitMask;
+#if SIMD_X86
+		if (BVH::getSIMDLevel() >= SIMDLevels::sse) {
+			groupHitMask = rayGroupTrianglesIntersectionSSE(triangles, first, triangleNum, origin, packet, group, groupMask);
+		}
+		else
+#endif
+		{
+			groupHitMask = rayGroupTrianglesIntersectionScalar(triangles, first, triangleNum, origin, packet, group, groupMask);
+		}
+		hitMask |= (uint64_t)groupHitMask << (group * RayPacket::groupSize);
+	}
+	return hitMask;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include "geometry.h"
+
+struct TriangleArrays;
+
+// Rays from a square block of pixels, which share an origin, stored as structure-of-arrays so
+// that a box or triangle can be tested against four of them at once. Sets of rays are passed
+// around as bitmasks, with bit i referring to ray i
+struct RayPacket {
+	static constexpr int maxRayNum = 64;
+	// Number of rays each vector operation works on
+	static constexpr int groupSize = 4;
+
+	Vec3 origin;
+	float dirX[maxRayNum], dirY[maxRayNum], dirZ[maxRayNum];
+	float invDirX[maxRayNum], invDirY[maxRayNum], invDirZ[maxRayNum];
+	// Distance to the closest hit found so far along each ray, and what was hit
+	float t[maxRayNum];
+	int triangleIndices[maxRayNum];
+	int instanceIndices[maxRayNum];
+	int rayNum;
+
+	RayPacket(const Vec3& _origin);
+	// Add a ray, which must start at the packet's origin, searching up to distance 'tMax' along it
+	void addRay(const Ray& ray, float tMax);
+	uint64_t getRayMask() const;
+	Vec3 getDirection(int index) const;
+	Vec3 getInvDirection(int index) const;
+};
+
+int countRays(uint64_t rayMask);
+
+// Slab test of a box against the rays in 'rayMask', with their origin moved to 'origin'. Returns the
+// rays that enter the box before their closest hit, and writes the entry distance of every ray tested
+uint64_t rayPacketBoxIntersection(const AABB& box, const Vec3& origin, const RayPacket& packet, uint64_t rayMask, float* tEntries);
+// Test a consecutive range of triangles against the rays in 'rayMask', updating the closest hit
+// of any ray that hits one of them sooner. Returns the rays whose closest hit was updated
+uint64_t rayPacketTrianglesIntersection(
+	const TriangleArrays& triangles,
+	uint32_t first,
+	uint32_t triangleNum,
+	const Vec3& origin,
+	RayPacket& packet,
+	uint64_t rayMask);
@@ -0,0 +1,248 @@
+#include <algorithm>
+#include "scene.h"
+#include "traversalstats.h"
+
+// Median splits keep the top-level hierarchy balanced, so this traversal stack is deep enough for any scene
+static constexpr int MAX_DEPTH = 64;
+
+void Scene::insertInstance(const Instance& instance) {
+	instances.push_back(instance);
+	isBuilt = false;
+}
+
+void Scene::setInstancePlacement(int index, Vec3 position, Mat3 rotation) {
+	instances[index].setPlacement(position, rotation);
+	isBuilt = false;
+}
+
+void Scene::updateInstanceBounds() {
+	// There are few enough instances that the top level is rebuilt rather than refitted
+	for (Instance& instance : instances) {
+		instance.updateBounds();
+	}
+	isBuilt = false;
+}
+
+void Scene::build() {
+	if (isBuilt) return;
+	nodes.clear();
+	instanceIndices.clear();
+	// Instances of models without any triangles can never be hit, so are left out of the hierarchy
+	std::vector<AABB> instanceBounds;
+	for (int i = 0; i < instances.size(); i++) {
+		instanceBounds.push_back(instances[i].getBounds());
+		if (!instanceBounds[i].isEmpty()) {
+			instanceIndices.push_back(i);
+		}
+	}
+	if (!instanceIndices.empty()) {
+		buildNode(0, instanceIndices.size(), instanceBounds);
+	}
+	isBuilt = true;
+}
+
+uint32_t Scene::buildNode(int start, int end, const std::vector<AABB>& instanceBounds) {
+	uint32_t nodeIndex = nodes.size();
+	AABB bounds, centerBounds;
+	for (int i = start; i < end; i++) {
+		bounds.grow(instanceBounds[instanceIndices[i]]);
+		centerBounds.grow(instanceBounds[instanceIndices[i]].getCenter());
+	}
+	nodes.push_back(LinearBVHNode{ bounds, 0, 0 });
+	if (end - start == 1) {
+		nodes[nodeIndex].offset = start;
+		nodes[nodeIndex].triangleNum = 1;
+		return nodeIndex;
+	}
+	// There are few enough instances that an even split on the widest axis is good enough
+	Vec3 extent = centerBounds.getExtent();
+	int axis = extent.x > extent.y && extent.x > extent.z ? 0 : (extent.y > extent.z ? 1 : 2);
+	int middle = (start + end) / 2;
+	std::nth_element(
+		instanceIndices.begin() + start, instanceIndices.begin() + middle, instanceIndices.begin() + end,
+		[&](uint32_t a, uint32_t b) {
+			Vec3 centerA = instanceBounds[a].getCenter();
+			Vec3 centerB = instanceBounds[b].getCenter();
+			if (axis == 0) return centerA.x < centerB.x;
+			else if (axis == 1) return centerA.y < centerB.y;
+			else return centerA.z < centerB.z;
+		});
+	buildNode(start, middle, instanceBounds);
+	uint32_t child1Index = buildNode(middle, end, instanceBounds);
+	nodes[nodeIndex].offset = child1Index;
+	return nodeIndex;
+}
+
+int Scene::getInstanceNum() const {
+	return instances.size();
+}
+
+const Instance& Scene::getInstance(int index) const {
+	return instances[index];
+}
+
+void Scene::insertLight(const Light& light) {
+	lights.push_back(light);
+}
+
+int Scene::getLightNum() const {
+	return lights.size();
+}
+
+const Light& Scene::getLight(int index) const {
+	return lights[index];
+}
+
+bool Scene::rayInstancesIntersection(const LinearBVHNode& node, const Ray& ray, float& t, int& instanceIndex, int& triangleIndex) const {
+	bool isIntersection = false;
+	for (uint32_t i = node.offset; i < node.offset + node.triangleNum; i++) {
+		// Each instance only reports a hit closer than the closest found so far
+		if (instances[instanceIndices[i]].rayIntersection(ray, t, triangleIndex)) {
+			instanceIndex = instanceIndices[i];
+			isIntersection = true;
+		}
+	}
+	return isIntersection;
+}
+
+bool Scene::rayIntersection(const Ray& ray, float& t, int& instanceIndex, int& triangleIndex) const {
+	if (nodes.empty()) return false;
+	const Vec3 origin = ray.getOrigin();
+	const Vec3 invDirection = ray.getInvDirection();
+	float tEntry;
+	COUNT_TRAVERSAL(boxTests, 1);
+	if (!nodes[0].bounds.rayIntersection(origin, invDirection, t, tEntry)) return false;
+	// The same front-to-back traversal as a model's BVH, with instances in place of triangles
+	TraversalEntry stack[MAX_DEPTH];
+	int stackSize = 0;
+	uint32_t nodeIndex = 0;
+	bool isIntersection = false;
+	while (true) {
+		const LinearBVHNode& node = nodes[nodeIndex];
+		COUNT_TRAVERSAL(nodesVisited, 1);
+		if (node.triangleNum > 0) {
+			isIntersection |= rayInstancesIntersection(node, ray, t, instanceIndex, triangleIndex);
+		}
+		else {
+			uint32_t childIndex0 = nodeIndex + 1;
+			uint32_t childIndex1 = node.offset;
+			float tEntry0, tEntry1;
+			COUNT_TRAVERSAL(boxTests, 2);
+			bool isHit0 = nodes[childIndex0].bounds.rayIntersection(origin, invDirection, t, tEntry0);
+			bool isHit1 = nodes[childIndex1].bounds.rayIntersection(origin, invDirection, t, tEntry1);
+			if (isHit0 && isHit1) {
+				if (tEntry1 < tEntry0) {
+					std::swap(childIndex0, childIndex1);
+					std::swap(tEntry0, tEntry1);
+				}
+				stack[stackSize++] = TraversalEntry{ childIndex1, tEntry1 };
+				nodeIndex = childIndex0;
+				continue;
+			}
+			else if (isHit0 || isHit1) {
+				nodeIndex = isHit0 ? childIndex0 : childIndex1;
+				continue;
+			}
+		}
+		while (stackSize > 0 && stack[stackSize - 1].tEntry >= t) {
+			stackSize--;
+		}
+		if (stackSize == 0) break;
+		nodeIndex = stack[--stackSize].nodeIndex;
+	}
+	return isIntersection;
+}
+
+bool Scene::isOccluded(const Ray& ray, float tMax) const {
+	if (nodes.empty()) return false;
+	const Vec3 origin = ray.getOrigin();
+	const Vec3 invDirection = ray.getInvDirection();
+	float tEntry;
+	COUNT_TRAVERSAL(boxTests, 1);
+	if (!nodes[0].bounds.rayIntersection(origin, invDirection, tMax, tEntry)) return false;
+	// Any hit will do, so children are visited in whatever order, and the first hit ends the search
+	uint32_t stack[MAX_DEPTH];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		uint32_t nodeIndex = stack[--stackSize];
+		const LinearBVHNode& node = nodes[nodeIndex];
+		COUNT_TRAVERSAL(nodesVisited, 1);
+		if (node.triangleNum > 0) {
+			for (uint32_t i = node.offset; i < node.offset + node.triangleNum; i++) {
+				if (instances[instanceIndices[i]].isOccluded(ray, tMax)) return true;
+			}
+			continue;
+		}
+		uint32_t childIndices[2] = { nodeIndex + 1, node.offset };
+		COUNT_TRAVERSAL(boxTests, 2);
+		for (uint32_t childIndex : childIndices) {
+			if (nodes[childIndex].bounds.rayIntersection(origin, invDirection, tMax, tEntry)) {
+				stack[stackSize++] = childIndex;
+			}
+		}
+	}
+	return false;
+}
+
+uint64_t Scene::rayPacketInstancesIntersection(const LinearBVHNode& node, RayPacket& packet, uint64_t rayMask) const {
+	uint64_t hitMask = 0;
+	for (uint32_t i = node.offset; i < node.offset + node.triangleNum; i++) {
+		uint64_t instanceHitMask = instances[instanceIndices[i]].rayPacketIntersection(packet, rayMask);
+		for (int ray = 0; ray < packet.rayNum; ray++) {
+			if (instanceHitMask & ((uint64_t)1 << ray)) packet.instanceIndices[ray] = instanceIndices[i];
+		}
+		hitMask |= instanceHitMask;
+	}
+	return hitMask;
+}
+
+void Scene::rayPacketIntersection(RayPacket& packet) const {
+	if (nodes.empty()) return;
+	float tEntries0[RayPacket::maxRayNum];
+	float tEntries1[RayPacket::maxRayNum];
+	COUNT_TRAVERSAL(boxTests, packet.rayNum);
+	uint64_t rayMask = rayPacketBoxIntersection(nodes[0].bounds, packet.origin, packet, packet.getRayMask(), tEntries0);
+	// The same traversal as a model's BVH does with packets, but without ever splitting them up
+	PacketTraversalEntry stack[MAX_DEPTH];
+	int stackSize = 0;
+	uint32_t nodeIndex = 0;
+	while (rayMask != 0) {
+		const LinearBVHNode& node = nodes[nodeIndex];
+		COUNT_TRAVERSAL(nodesVisited, countRays(rayMask));
+		if (node.triangleNum > 0) {
+			rayPacketInstancesIntersection(node, packet, rayMask);
+		}
+		else {
+			uint32_t childIndex0 = nodeIndex + 1;
+			uint32_t childIndex1 = node.offset;
+			COUNT_TRAVERSAL(boxTests, 2 * countRays(rayMask));
+			uint64_t rayMask0 = rayPacketBoxIntersection(nodes[childIndex0].bounds, packet.origin, packet, rayMask, tEntries0);
+			uint64_t rayMask1 = rayPacketBoxIntersection(nodes[childIndex1].bounds, packet.origin, packet, rayMask, tEntries1);
+			if (rayMask0 != 0 && rayMask1 != 0) {
+				uint64_t bothMask = rayMask0 & rayMask1;
+				if (bothMask != 0) {
+					int ray = 0;
+					while (!(bothMask & ((uint64_t)1 << ray))) ray++;
+					if (tEntries1[ray] < tEntries0[ray]) {
+						std::swap(childIndex0, childIndex1);
+						std::swap(rayMask0, rayMask1);
+					}
+				}
+				stack[stackSize++] = PacketTraversalEntry{ childIndex1, rayMask1 };
+				nodeIndex = childIndex0;
+				rayMask = rayMask0;
+				continue;
+			}
+			else if (rayMask0 != 0 || rayMask1 != 0) {
+				nodeIndex = rayMask0 != 0 ? childIndex0 : childIndex1;
+				rayMask = rayMask0 | rayMask1;
+				continue;
+			}
+		}
+		if (stackSize == 0) break;
+		stackSize--;
+		nodeIndex = stack[stackSize].nodeIndex;
+		rayMask = stack[stackSize].rayMask;
+	}
+}
\ No newline at end of file
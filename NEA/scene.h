@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include "instance.h"
+#include "light.h"
+
+// Collection of the model instances being rendered, with a top-level bounding volume hierarchy over
+// their world-space bounds. Each instance's model's BVH is then only searched when its bounds are hit
+struct Scene {
+private:
+	std::vector<Instance> instances;
+	std::vector<Light> lights;
+	// Top-level nodes, in the same layout as a model's BVH, with leaves referring to ranges of 'instanceIndices'
+	std::vector<LinearBVHNode> nodes;
+	std::vector<uint32_t> instanceIndices;
+	bool isBuilt = false;
+
+	struct TraversalEntry {
+		uint32_t nodeIndex;
+		float tEntry;
+	};
+	struct PacketTraversalEntry {
+		uint32_t nodeIndex;
+		uint64_t rayMask;
+	};
+
+	uint32_t buildNode(int start, int end, const std::vector<AABB>& instanceBounds);
+	bool rayInstancesIntersection(const LinearBVHNode& node, const Ray& ray, float& t, int& instanceIndex, int& triangleIndex) const;
+	uint64_t rayPacketInstancesIntersection(const LinearBVHNode& node, RayPacket& packet, uint64_t rayMask) const;
+public:
+	void insertInstance(const Instance& instance);
+	// Move one instance. The top-level hierarchy is rebuilt before the next render
+	void setInstancePlacement(int index, Vec3 position, Mat3 rotation);
+	// Refit every instance's bounds to its model, after any of the models' vertices have been moved
+	void updateInstanceBounds();
+	// Build the top-level hierarchy, if any instances have been inserted since it was last built
+	void build();
+
+	int getInstanceNum() const;
+	const Instance& getInstance(int index) const;
+	void insertLight(const Light& light);
+	int getLightNum() const;
+	const Light& getLight(int index) const;
+	// Find the closest intersection across every instance. 't' is the furthest distance searched,
+	// and is set to the distance of the closest hit (if any) along with the indices of what was hit
+	bool rayIntersection(const Ray& ray, float& t, int& instanceIndex, int& triangleIndex) const;
+	// Whether the ray hits anything closer than 'tMax'. Stops at the first hit found, in any instance,
+	// so costs far less than finding the closest hit. Used for shadow rays
+	bool isOccluded(const Ray& ray, float tMax) const;
+	// Find the closest intersection of every ray in a packet, setting the distances and indices held by the packet
+	void rayPacketIntersection(RayPacket& packet) const;
+};
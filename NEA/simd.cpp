@@ -0,0 +1,44 @@
+#include "simd.h"
+
+#if SIMD_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static SIMDLevels::SIMDLevel detectSIMDLevel() {
+#if !SIMD_X86
+	return SIMDLevels::scalar;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+	__cpuid(info, 1);
+	bool hasSSE2 = (info[3] & (1 << 26)) != 0;
+	// AVX registers are only usable if the OS saves them on context switches
+	bool hasOSXSAVE = (info[2] & (1 << 27)) != 0;
+	bool hasAVX = (info[2] & (1 << 28)) != 0;
+	if (hasOSXSAVE && hasAVX && maxLeaf >= 7 && (_xgetbv(0) & 6) == 6) {
+		__cpuidex(info, 7, 0);
+		if (info[1] & (1 << 5)) return SIMDLevels::avx2;
+	}
+	return hasSSE2 ? SIMDLevels::sse : SIMDLevels::scalar;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return SIMDLevels::avx2;
+	if (__builtin_cpu_supports("sse2")) return SIMDLevels::sse;
+	return SIMDLevels::scalar;
+#endif
+}
+
+SIMDLevels::SIMDLevel getSupportedSIMDLevel() {
+	// The CPU can't change while running, so only ask it once
+	static const SIMDLevels::SIMDLevel level = detectSIMDLevel();
+	return level;
+}
+
+const char* getSIMDLevelName(SIMDLevels::SIMDLevel level) {
+	switch (level) {
+	case SIMDLevels::sse:  return "sse";
+	case SIMDLevels::avx2: return "avx2";
+	default:               return "scalar";
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+// Whether the target has SSE/AVX intrinsics available at all. Other targets only use the scalar code,
+// apart from the 4-wide vector type, which uses NEON where it can
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_X86 0
+#endif
+
+// Whether the target has 64-bit ARM's NEON intrinsics, which every CPU of it supports
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#define SIMD_NEON 0
+#endif
+
+// GCC and Clang only allow AVX2 intrinsics in functions compiled for AVX2, whereas MSVC allows them
+// anywhere. Only AVX2 is enabled, not FMA, so multiplies and adds are never fused and round the same
+// way as the scalar code
+#if SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace SIMDLevels {
+	enum SIMDLevel {
+		scalar, // Plain floating point
+		sse,    // 4 floats at a time
+		avx2    // 8 floats at a time
+	};
+}
+
+// Widest instruction set supported by both the build and the CPU it is running on
+SIMDLevels::SIMDLevel getSupportedSIMDLevel();
+const char* getSIMDLevelName(SIMDLevels::SIMDLevel level);
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include "threadpool.h"
+
+// The pool and queue index of the worker running on the current thread (if any)
+static thread_local ThreadPool* currentPool = nullptr;
+static thread_local int currentWorkerIndex = -1;
+
+TaskGroup::TaskGroup()
+	: pending(0) {
+}
+
+ThreadPool::ThreadPool(int threadNum)
+	: queuedTaskNum(0), nextQueue(0) {
+	if (threadNum <= 0) {
+		threadNum = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+	for (int i = 0; i < threadNum; i++) {
+		queues.push_back(std::make_unique<WorkerQueue>());
+	}
+	for (int i = 0; i < threadNum; i++) {
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wakeCondition.notify_all();
+	for (int i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+}
+
+int ThreadPool::getThreadNum() const {
+	return (int)workers.size();
+}
+
+void ThreadPool::submit(TaskGroup& group, std::function<void()> function) {
+	// Workers push onto their own queue, other threads spread tasks over all the queues
+	int queueIndex = currentWorkerIndex;
+	if (currentPool != this) {
+		queueIndex = nextQueue.fetch_add(1) % queues.size();
+	}
+	group.pending.fetch_add(1);
+	{
+		std::lock_guard<std::mutex> lock(queues[queueIndex]->mutex);
+		queues[queueIndex]->tasks.push_back(Task{ std::move(function), &group });
+	}
+	queuedTaskNum.fetch_add(1);
+	// Take the sleep lock so a worker can't miss the notification between checking for tasks and sleeping
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	wakeCondition.notify_one();
+}
+
+void ThreadPool::wait(TaskGroup& group) {
+	int workerIndex = currentPool == this ? currentWorkerIndex : -1;
+	Task task;
+	while (group.pending.load() > 0) {
+		// Help out with queued work rather than blocking, which also
+		// stops tasks that wait on their own subtasks from deadlocking
+		if (findTask(workerIndex, task)) {
+			runTask(task);
+		}
+		else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void ThreadPool::parallelFor(int taskNum, const std::function<void(int)>& function) {
+	TaskGroup group;
+	for (int i = 0; i < taskNum; i++) {
+		submit(group, [&function, i]() { function(i); });
+	}
+	wait(group);
+}
+
+void ThreadPool::workerLoop(int workerIndex) {
+	currentPool = this;
+	currentWorkerIndex = workerIndex;
+	Task task;
+	while (true) {
+		if (findTask(workerIndex, task)) {
+			runTask(task);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wakeCondition.wait(lock, [this]() { return stopping || queuedTaskNum.load() > 0; });
+		if (stopping) return;
+	}
+}
+
+bool ThreadPool::popTask(int queueIndex, Task& task) {
+	// The owner of a queue takes the most recently pushed task
+	WorkerQueue& queue = *queues[queueIndex];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.tasks.empty()) return false;
+	task = std::move(queue.tasks.back());
+	queue.tasks.pop_back();
+	queuedTaskNum.fetch_sub(1);
+	return true;
+}
+
+bool ThreadPool::stealTask(int thiefIndex, Task& task) {
+	// Thieves take the oldest task from the other queues, starting after their own
+	int queueNum = (int)queues.size();
+	for (int i = 1; i <= queueNum; i++) {
+		int queueIndex = (thiefIndex + i + queueNum) % queueNum;
+		WorkerQueue& queue = *queues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty()) {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			queuedTaskNum.fetch_sub(1);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ThreadPool::findTask(int workerIndex, Task& task) {
+	if (workerIndex >= 0 && popTask(workerIndex, task)) return true;
+	return stealTask(workerIndex < 0 ? 0 : workerIndex, task);
+}
+
+void ThreadPool::runTask(Task& task) {
+	TaskGroup* group = task.group;
+	task.function();
+	task.function = nullptr;
+	group->pending.fetch_sub(1);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// Counts the outstanding tasks submitted to a thread pool, so that a caller can wait on them
+struct TaskGroup {
+	std::atomic<int> pending;
+
+	TaskGroup();
+};
+
+// Fixed-size pool of worker threads, each owning a double-ended task queue.
+// Workers take tasks from the back of their own queue, and when it is empty
+// steal from the front of another worker's queue, so that threads that finish
+// their share early keep busy with work left over by the others
+struct ThreadPool {
+private:
+	struct Task {
+		std::function<void()> function;
+		TaskGroup* group;
+	};
+	struct WorkerQueue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	std::mutex sleepMutex;
+	std::condition_variable wakeCondition;
+	std::atomic<int> queuedTaskNum;
+	std::atomic<unsigned int> nextQueue;
+	bool stopping = false;
+
+	void workerLoop(int workerIndex);
+	bool popTask(int queueIndex, Task& task);
+	bool stealTask(int thiefIndex, Task& task);
+	bool findTask(int workerIndex, Task& task);
+	void runTask(Task& task);
+public:
+	// A thread number of zero sizes the pool to the number of hardware threads
+	ThreadPool(int threadNum = 0);
+	~ThreadPool();
+	ThreadPool(const ThreadPool& other) = delete;
+
+	int getThreadNum() const;
+	void submit(TaskGroup& group, std::function<void()> function);
+	// Block until every task in the group has completed, running queued tasks in the meantime
+	void wait(TaskGroup& group);
+	// Run 'function' for every index in [0, taskNum), returning once all have completed
+	void parallelFor(int taskNum, const std::function<void(int)>& function);
+};
@@ -12,7 +12,7 @@ Transform::Transform(float rotX, float rotY, float rotZ, bool _flipX, bool _flip
 }
 
 Transform::Transform(const Transform& other) 
-	: mat(other.mat) {
+	: mat(other.mat), flipX(other.flipX), flipY(other.flipY), flipZ(other.flipZ) {
 }
 
 Vec3 Transform::transform(const Vec3& vec) const {
@@ -20,13 +20,28 @@ Vec3 Transform::transform(const Vec3& vec) const {
 }
 
 void Transform::flipVertexIndices(int& v0Index, int& v1Index) const {
-	bool flipOneAxis = flipX != flipY != flipZ;
-	bool flipAllAxes = flipX && flipY && flipZ;
-	if (flipOneAxis || flipAllAxes) { // XOR or all equal
+	if (flipsWinding()) {
 		std::swap(v0Index, v1Index);
 	}
 }
 
+Mat3 Transform::getMatrix() const {
+	return mat;
+}
+
+bool Transform::flipsWinding() const {
+	bool flipOneAxis = flipX != flipY != flipZ;
+	bool flipAllAxes = flipX && flipY && flipZ;
+	return flipOneAxis || flipAllAxes; // XOR or all equal
+}
+
+Transform Transform::getMirrored() const {
+	Transform mirrored(*this);
+	mirrored.flipX = !flipX;
+	mirrored.mat = mat * calcRefMat(true, false, false);
+	return mirrored;
+}
+
 Mat3 Transform::calcRotMat(const float rotX, const float rotY, const float rotZ) const {
 	float cx = cos(rotX * DEG2RAD);
 	float sx = sin(rotX * DEG2RAD);
@@ -17,6 +17,11 @@ struct Transform {
 
 	Vec3 transform(const Vec3& vector) const;
 	void flipVertexIndices(int& v0Index, int& v1Index) const;
+	Mat3 getMatrix() const;
+	// Whether the transform mirrors the model, turning its triangles' winding around
+	bool flipsWinding() const;
+	// Get the same transform with the model's x axis also reflected, before it is rotated
+	Transform getMirrored() const;
 private:
 	Mat3 mat;
 	bool flipX, flipY, flipZ;
@@ -0,0 +1,145 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include "traversalstats.h"
+#include "framebuffer.h"
+#include "postprocess.h"
+
+// Fraction of pixels shown in the heatmap's colour ramp. Any beyond it are shown as white
+static constexpr float HEATMAP_PERCENTILE = 0.99f;
+// Colours the heatmap ramp runs through, evenly spaced from no work to the percentile above
+static const Vec3 HEATMAP_COLOURS[] = {
+	Vec3(0.0f, 0.0f, 0.25f),
+	Vec3(0.0f, 0.0f, 1.0f),
+	Vec3(0.0f, 1.0f, 1.0f),
+	Vec3(0.0f, 1.0f, 0.0f),
+	Vec3(1.0f, 1.0f, 0.0f),
+	Vec3(1.0f, 0.0f, 0.0f)
+};
+static constexpr int HEATMAP_COLOUR_NUM = sizeof(HEATMAP_COLOURS) / sizeof(HEATMAP_COLOURS[0]);
+static const Vec3 HEATMAP_OUTLIER_COLOUR = Vec3(1.0f, 1.0f, 1.0f);
+// Buckets in each histogram, and the width of the longest bar in characters
+static constexpr int HISTOGRAM_BUCKET_NUM = 10;
+static constexpr int HISTOGRAM_BAR_WIDTH = 40;
+
+static const TraversalCounters::TraversalCounter COUNTERS[] = {
+	TraversalCounters::boxTests,
+	TraversalCounters::nodesVisited,
+	TraversalCounters::triangleTests
+};
+
+#if TRAVERSAL_STATS
+thread_local TraversalCounts threadTraversalCounts;
+#endif
+
+// Colour of a count on the heatmap ramp, where 'scale' is the count shown as the last colour
+static Vec3 getHeatmapColour(uint32_t count, uint32_t scale) {
+	if (count > scale) return HEATMAP_OUTLIER_COLOUR;
+	float position = scale > 0 ? count / (float)scale * (HEATMAP_COLOUR_NUM - 1) : 0.0f;
+	int index = std::min((int)position, HEATMAP_COLOUR_NUM - 2);
+	float fraction = position - index;
+	return HEATMAP_COLOURS[index] * (1.0f - fraction) + HEATMAP_COLOURS[index + 1] * fraction;
+}
+
+TraversalStats::TraversalStats(int _width, int _height) {
+	reset(_width, _height);
+}
+
+void TraversalStats::reset(int _width, int _height) {
+	width = _width;
+	height = _height;
+	pixels.assign((size_t)width * height, TraversalCounts());
+}
+
+void TraversalStats::fillBlock(int x, int y, int size, const TraversalCounts& counts) {
+	int endX = std::min(x + size, width);
+	int endY = std::min(y + size, height);
+	for (int blockY = y; blockY < endY; blockY++) {
+		std::fill(pixels.begin() + (size_t)blockY * width + x, pixels.begin() + (size_t)blockY * width + endX, counts);
+	}
+}
+
+const TraversalCounts& TraversalStats::getCounts(int x, int y) const {
+	return pixels[(size_t)y * width + x];
+}
+
+double TraversalStats::getMean(TraversalCounters::TraversalCounter counter) const {
+	if (pixels.empty()) return 0.0;
+	double sum = 0.0;
+	for (const TraversalCounts& counts : pixels) {
+		sum += counts.get(counter);
+	}
+	return sum / pixels.size();
+}
+
+uint32_t TraversalStats::getPercentile(TraversalCounters::TraversalCounter counter, float fraction) const {
+	if (pixels.empty()) return 0;
+	std::vector<uint32_t> values(pixels.size());
+	for (size_t i = 0; i < pixels.size(); i++) {
+		values[i] = pixels[i].get(counter);
+	}
+	size_t index = std::min((size_t)(fraction * values.size()), values.size() - 1);
+	std::nth_element(values.begin(), values.begin() + index, values.end());
+	return values[index];
+}
+
+bool TraversalStats::writeHeatmap(const std::string& path, TraversalCounters::TraversalCounter counter) const {
+	uint32_t scale = getPercentile(counter, HEATMAP_PERCENTILE);
+	Framebuffer heatmap(width, height);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			heatmap.setPixel(x, y, getHeatmapColour(getCounts(x, y).get(counter), scale));
+		}
+	}
+	// The ramp's colours are written as they are, without any tone mapping or gamma correction
+	static const PostProcess heatmapPostProcess(1.0f, ToneCurves::clamp, 1.0f);
+	if (!heatmap.writePPM(path, heatmapPostProcess)) return false;
+	std::cout << "Heatmap of " << getCounterName(counter) << " written to " << path << ", red at " << scale << " per pixel\n";
+	return true;
+}
+
+bool TraversalStats::writeHeatmaps(const std::string& path) const {
+	// Only a dot after the last directory separator starts an extension
+	size_t dot = path.find_last_of('.');
+	size_t separator = path.find_last_of("/\\");
+	if (dot == std::string::npos || (separator != std::string::npos && dot < separator)) dot = path.size();
+	bool isWritten = true;
+	for (TraversalCounters::TraversalCounter counter : COUNTERS) {
+		std::string name = getCounterName(counter);
+		std::replace(name.begin(), name.end(), ' ', '_');
+		isWritten &= writeHeatmap(path.substr(0, dot) + "_" + name + path.substr(dot), counter);
+	}
+	return isWritten;
+}
+
+void TraversalStats::printHistograms() const {
+	for (TraversalCounters::TraversalCounter counter : COUNTERS) {
+		uint32_t maxCount = 0;
+		for (const TraversalCounts& counts : pixels) {
+			maxCount = std::max(maxCount, counts.get(counter));
+		}
+		std::cout << "\n" << getCounterName(counter) << " per pixel: mean " << getMean(counter)
+			<< ", median " << getPercentile(counter, 0.5f) << ", 99th percentile " << getPercentile(counter, HEATMAP_PERCENTILE)
+			<< ", max " << maxCount << "\n";
+		// Buckets are whole numbers of counts wide, so the last may reach past the maximum
+		uint32_t bucketWidth = maxCount / HISTOGRAM_BUCKET_NUM + 1;
+		size_t bucketPixelNums[HISTOGRAM_BUCKET_NUM] = {};
+		for (const TraversalCounts& counts : pixels) {
+			bucketPixelNums[counts.get(counter) / bucketWidth]++;
+		}
+		size_t largestBucket = *std::max_element(bucketPixelNums, bucketPixelNums + HISTOGRAM_BUCKET_NUM);
+		for (int i = 0; i < HISTOGRAM_BUCKET_NUM; i++) {
+			int barWidth = largestBucket > 0 ? (int)(bucketPixelNums[i] * HISTOGRAM_BAR_WIDTH / largestBucket) : 0;
+			std::cout << std::setw(8) << i * bucketWidth << " - " << std::setw(8) << (i + 1) * bucketWidth - 1 << " | "
+				<< std::string(barWidth, '#') << std::string(HISTOGRAM_BAR_WIDTH - barWidth, ' ') << " " << bucketPixelNums[i] << "\n";
+		}
+	}
+}
+
+const char* TraversalStats::getCounterName(TraversalCounters::TraversalCounter counter) {
+	switch (counter) {
+	case TraversalCounters::boxTests: return "box tests";
+	case TraversalCounters::nodesVisited: return "nodes visited";
+	default: return "triangle tests";
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+// Build with TRAVERSAL_STATS defined as 1 to count the work each ray does in the hierarchies. While it is
+// 0, the counting macros expand to nothing, so the traversal code compiles exactly as it would without them
+#ifndef TRAVERSAL_STATS
+#define TRAVERSAL_STATS 0
+#endif
+
+namespace TraversalCounters {
+	enum TraversalCounter {
+		boxTests,     // Ray-box slab tests, one per child box a ray is tested against
+		nodesVisited, // Interior nodes and leaves a ray is traced into
+		triangleTests // Ray-triangle tests
+	};
+}
+
+// Work done tracing one ray, or all the rays of one pixel
+struct TraversalCounts {
+	uint32_t boxTests = 0;
+	uint32_t nodesVisited = 0;
+	uint32_t triangleTests = 0;
+
+	uint32_t get(TraversalCounters::TraversalCounter counter) const {
+		if (counter == TraversalCounters::boxTests) return boxTests;
+		if (counter == TraversalCounters::nodesVisited) return nodesVisited;
+		return triangleTests;
+	}
+	TraversalCounts& operator+=(const TraversalCounts& counts) {
+		boxTests += counts.boxTests;
+		nodesVisited += counts.nodesVisited;
+		triangleTests += counts.triangleTests;
+		return *this;
+	}
+	// Even share of the counts for each of 'rayNum' rays, as when they were traced together as a packet
+	TraversalCounts getShare(int rayNum) const {
+		TraversalCounts share;
+		share.boxTests = boxTests / rayNum;
+		share.nodesVisited = nodesVisited / rayNum;
+		share.triangleTests = triangleTests / rayNum;
+		return share;
+	}
+};
+
+#if TRAVERSAL_STATS
+// Work done by the rays traced on this thread since its counts were last reset. Each thread only ever
+// adds to its own counts, so counting needs no locks or atomics, and threads never share cache lines
+extern thread_local TraversalCounts threadTraversalCounts;
+#define COUNT_TRAVERSAL(counter, n) (threadTraversalCounts.counter += (uint32_t)(n))
+#define RESET_TRAVERSAL_COUNTS() (threadTraversalCounts = TraversalCounts())
+#else
+#define COUNT_TRAVERSAL(counter, n) ((void)0)
+#define RESET_TRAVERSAL_COUNTS() ((void)0)
+#endif
+
+// Counts of the work done for each pixel of a render, which can be written as false-colour heatmaps
+// and summarised as histograms. Each pixel is only written by the thread that traced it
+struct TraversalStats {
+private:
+	int width, height;
+	std::vector<TraversalCounts> pixels;
+
+	// Count below which the given fraction of pixels fall
+	uint32_t getPercentile(TraversalCounters::TraversalCounter counter, float fraction) const;
+public:
+	TraversalStats(int _width = 0, int _height = 0);
+
+	// Resize to an image, and set every pixel's counts to zero
+	void reset(int _width, int _height);
+	// Set a square block of pixels from its top-left corner, cut short at the edges of the image
+	void fillBlock(int x, int y, int size, const TraversalCounts& counts);
+	const TraversalCounts& getCounts(int x, int y) const;
+	double getMean(TraversalCounters::TraversalCounter counter) const;
+
+	// Write one counter as a binary PPM, running from dark blue for no work through cyan, green and yellow
+	// to red at the 99th percentile. The few pixels beyond it are white, so they don't wash out the rest
+	bool writeHeatmap(const std::string& path, TraversalCounters::TraversalCounter counter) const;
+	// Write a heatmap of every counter, named by inserting the counter's name before the extension of 'path'
+	bool writeHeatmaps(const std::string& path) const;
+	// Print the mean, percentiles and a histogram of each counter over every pixel to the console
+	void printHistograms() const;
+
+	static const char* getCounterName(TraversalCounters::TraversalCounter counter);
+};
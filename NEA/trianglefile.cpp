@@ -0,0 +1,45 @@
+#include "trianglefile.h"
+#include "model.h"
+
+TriangleFile::TriangleFile()
+	: file(tmpfile()) {
+}
+
+TriangleFile::~TriangleFile() {
+	close();
+}
+
+bool TriangleFile::isOpen() const {
+	return file != nullptr;
+}
+
+size_t TriangleFile::size() const {
+	return triangleNum;
+}
+
+void TriangleFile::write(const std::vector<Triangle>& triangles) {
+	// Writing always appends, wherever reading had got to
+	fseek(file, 0, SEEK_END);
+	triangleNum += fwrite(triangles.data(), sizeof(Triangle), triangles.size(), file);
+}
+
+void TriangleFile::rewind() {
+	fseek(file, 0, SEEK_SET);
+}
+
+bool TriangleFile::read(std::vector<Triangle>& triangles, size_t maxNum) {
+	triangles.resize(maxNum);
+	triangles.resize(fread(triangles.data(), sizeof(Triangle), maxNum, file));
+	return !triangles.empty();
+}
+
+void TriangleFile::readAll(std::vector<Triangle>& triangles) {
+	rewind();
+	read(triangles, triangleNum);
+}
+
+void TriangleFile::close() {
+	if (file != nullptr) fclose(file);
+	file = nullptr;
+	triangleNum = 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+
+struct Triangle;
+
+// Triangles kept in an anonymous temporary file, written and read back in batches, so that a
+// large mesh can be passed between the stages of loading it without being held in memory
+struct TriangleFile {
+private:
+	FILE* file;
+	size_t triangleNum = 0;
+public:
+	TriangleFile();
+	~TriangleFile();
+	TriangleFile(const TriangleFile& other) = delete;
+	TriangleFile& operator=(const TriangleFile& other) = delete;
+
+	// False if no temporary file could be created
+	bool isOpen() const;
+	size_t size() const;
+	void write(const std::vector<Triangle>& triangles);
+	// Go back to the first triangle, after which every triangle is read in the order it was written
+	void rewind();
+	// Replace the contents of 'triangles' with up to 'maxNum' of the next triangles, returning false once there are none
+	bool read(std::vector<Triangle>& triangles, size_t maxNum);
+	void readAll(std::vector<Triangle>& triangles);
+	// Delete the file once its triangles are no longer needed, freeing the disk space
+	void close();
+};
@@ -0,0 +1,150 @@
+#include "trianglekernels.h"
+#include "BVH.h"
+
+// Every kernel is the Moller-Trumbore algorithm, with its operations done in the same order so that
+// each gives bit-identical distances, and the same triangles are accepted and rejected
+//https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle/moller-trumbore-ray-triangle-intersection
+//http://www.lighthouse3d.com/tutorials/maths/ray-triangle-intersection/
+
+static bool rayTriangleIntersection(const TriangleArrays& triangles, uint32_t index, const Vec3& rayOrigin, const Vec3& rayDirection, float& t) {
+	Vec3 v0 = Vec3(triangles.v0x[index], triangles.v0y[index], triangles.v0z[index]);
+	Vec3 edge0 = Vec3(triangles.edge0x[index], triangles.edge0y[index], triangles.edge0z[index]);
+	Vec3 edge1 = Vec3(triangles.edge1x[index], triangles.edge1y[index], triangles.edge1z[index]);
+
+	Vec3 pvec = rayDirection.cross(edge1);
+	float det = edge0.dot(pvec);
+	if (det <= MIN_DETERMINANT) return false;
+	float invDet = 1 / det;
+
+	Vec3 tvec = rayOrigin - v0;
+	float u = tvec.dot(pvec) * invDet;
+	if (u < 0.0f || u > 1.0f) return false;
+	Vec3 qvec = tvec.cross(edge0);
+	float v = rayDirection.dot(qvec) * invDet;
+	if (v < 0.0f || u + v > 1.0f) return false;
+	t = edge1.dot(qvec) * invDet;
+	return true;
+}
+
+int rayTrianglesIntersectionScalar(const TriangleArrays& triangles, uint32_t first, int count, const Vec3& rayOrigin, const Vec3& rayDirection, float* dists) {
+	int hitMask = 0;
+	for (int i = 0; i < count; i++) {
+		if (rayTriangleIntersection(triangles, first + i, rayOrigin, rayDirection, dists[i]) && dists[i] > 0.0f) {
+			hitMask |= 1 << i;
+		}
+	}
+	return hitMask;
+}
+
+#if SIMD_X86
+
+// ------------------------------- //
+//               SSE               //
+// ------------------------------- //
+
+int rayTrianglesIntersectionSSE(const TriangleArrays& triangles, uint32_t first, int count, const Vec3& rayOrigin, const Vec3& rayDirection, float* dists) {
+	const __m128 dirX = _mm_set1_ps(rayDirection.x);
+	const __m128 dirY = _mm_set1_ps(rayDirection.y);
+	const __m128 dirZ = _mm_set1_ps(rayDirection.z);
+	const __m128 v0x = _mm_loadu_ps(&triangles.v0x[first]);
+	const __m128 v0y = _mm_loadu_ps(&triangles.v0y[first]);
+	const __m128 v0z = _mm_loadu_ps(&triangles.v0z[first]);
+	const __m128 edge0x = _mm_loadu_ps(&triangles.edge0x[first]);
+	const __m128 edge0y = _mm_loadu_ps(&triangles.edge0y[first]);
+	const __m128 edge0z = _mm_loadu_ps(&triangles.edge0z[first]);
+	const __m128 edge1x = _mm_loadu_ps(&triangles.edge1x[first]);
+	const __m128 edge1y = _mm_loadu_ps(&triangles.edge1y[first]);
+	const __m128 edge1z = _mm_loadu_ps(&triangles.edge1z[first]);
+
+	// pvec = rayDirection x edge1
+	__m128 pvecX = _mm_sub_ps(_mm_mul_ps(dirY, edge1z), _mm_mul_ps(dirZ, edge1y));
+	__m128 pvecY = _mm_sub_ps(_mm_mul_ps(dirZ, edge1x), _mm_mul_ps(dirX, edge1z));
+	__m128 pvecZ = _mm_sub_ps(_mm_mul_ps(dirX, edge1y), _mm_mul_ps(dirY, edge1x));
+	__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge0x, pvecX), _mm_mul_ps(edge0y, pvecY)), _mm_mul_ps(edge0z, pvecZ));
+	__m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	__m128 tvecX = _mm_sub_ps(_mm_set1_ps(rayOrigin.x), v0x);
+	__m128 tvecY = _mm_sub_ps(_mm_set1_ps(rayOrigin.y), v0y);
+	__m128 tvecZ = _mm_sub_ps(_mm_set1_ps(rayOrigin.z), v0z);
+	__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tvecX, pvecX), _mm_mul_ps(tvecY, pvecY)), _mm_mul_ps(tvecZ, pvecZ)), invDet);
+	// qvec = tvec x edge0
+	__m128 qvecX = _mm_sub_ps(_mm_mul_ps(tvecY, edge0z), _mm_mul_ps(tvecZ, edge0y));
+	__m128 qvecY = _mm_sub_ps(_mm_mul_ps(tvecZ, edge0x), _mm_mul_ps(tvecX, edge0z));
+	__m128 qvecZ = _mm_sub_ps(_mm_mul_ps(tvecX, edge0y), _mm_mul_ps(tvecY, edge0x));
+	__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dirX, qvecX), _mm_mul_ps(dirY, qvecY)), _mm_mul_ps(dirZ, qvecZ)), invDet);
+	__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1x, qvecX), _mm_mul_ps(edge1y, qvecY)), _mm_mul_ps(edge1z, qvecZ)), invDet);
+
+	// The same ordered comparisons as the scalar code, so that NaNs are treated identically
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	__m128 miss = _mm_cmple_ps(det, _mm_set1_ps(MIN_DETERMINANT));
+	miss = _mm_or_ps(miss, _mm_or_ps(_mm_cmplt_ps(u, zero), _mm_cmpgt_ps(u, one)));
+	miss = _mm_or_ps(miss, _mm_or_ps(_mm_cmplt_ps(v, zero), _mm_cmpgt_ps(_mm_add_ps(u, v), one)));
+	__m128 hit = _mm_andnot_ps(miss, _mm_cmpgt_ps(t, zero));
+
+	_mm_storeu_ps(dists, t);
+	// Lanes past the end of the leaf hold other leaves' triangles or padding
+	return _mm_movemask_ps(hit) & ((1 << count) - 1);
+}
+
+// ------------------------------- //
+//               AVX2              //
+// ------------------------------- //
+
+TARGET_AVX2
+int rayTrianglesIntersectionAVX2(const TriangleArrays& triangles, uint32_t first, int count, const Vec3& rayOrigin, const Vec3& rayDirection, float* dists) {
+	const __m256 dirX = _mm256_set1_ps(rayDirection.x);
+	const __m256 dirY = _mm256_set1_ps(rayDirection.y);
+	const __m256 dirZ = _mm256_set1_ps(rayDirection.z);
+	const __m256 v0x = _mm256_loadu_ps(&triangles.v0x[first]);
+	const __m256 v0y = _mm256_loadu_ps(&triangles.v0y[first]);
+	const __m256 v0z = _mm256_loadu_ps(&triangles.v0z[first]);
+	const __m256 edge0x = _mm256_loadu_ps(&triangles.edge0x[first]);
+	const __m256 edge0y = _mm256_loadu_ps(&triangles.edge0y[first]);
+	const __m256 edge0z = _mm256_loadu_ps(&triangles.edge0z[first]);
+	const __m256 edge1x = _mm256_loadu_ps(&triangles.edge1x[first]);
+	const __m256 edge1y = _mm256_loadu_ps(&triangles.edge1y[first]);
+	const __m256 edge1z = _mm256_loadu_ps(&triangles.edge1z[first]);
+
+	// pvec = rayDirection x edge1
+	__m256 pvecX = _mm256_sub_ps(_mm256_mul_ps(dirY, edge1z), _mm256_mul_ps(dirZ, edge1y));
+	__m256 pvecY = _mm256_sub_ps(_mm256_mul_ps(dirZ, edge1x), _mm256_mul_ps(dirX, edge1z));
+	__m256 pvecZ = _mm256_sub_ps(_mm256_mul_ps(dirX, edge1y), _mm256_mul_ps(dirY, edge1x));
+	__m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge0x, pvecX), _mm256_mul_ps(edge0y, pvecY)), _mm256_mul_ps(edge0z, pvecZ));
+	__m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+
+	__m256 tvecX = _mm256_sub_ps(_mm256_set1_ps(rayOrigin.x), v0x);
+	__m256 tvecY = _mm256_sub_ps(_mm256_set1_ps(rayOrigin.y), v0y);
+	__m256 tvecZ = _mm256_sub_ps(_mm256_set1_ps(rayOrigin.z), v0z);
+	__m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tvecX, pvecX), _mm256_mul_ps(tvecY, pvecY)), _mm256_mul_ps(tvecZ, pvecZ)), invDet);
+	// qvec = tvec x edge0
+	__m256 qvecX = _mm256_sub_ps(_mm256_mul_ps(tvecY, edge0z), _mm256_mul_ps(tvecZ, edge0y));
+	__m256 qvecY = _mm256_sub_ps(_mm256_mul_ps(tvecZ, edge0x), _mm256_mul_ps(tvecX, edge0z));
+	__m256 qvecZ = _mm256_sub_ps(_mm256_mul_ps(tvecX, edge0y), _mm256_mul_ps(tvecY, edge0x));
+	__m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dirX, qvecX), _mm256_mul_ps(dirY, qvecY)), _mm256_mul_ps(dirZ, qvecZ)), invDet);
+	__m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge1x, qvecX), _mm256_mul_ps(edge1y, qvecY)), _mm256_mul_ps(edge1z, qvecZ)), invDet);
+
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	__m256 miss = _mm256_cmp_ps(det, _mm256_set1_ps(MIN_DETERMINANT), _CMP_LE_OQ);
+	miss = _mm256_or_ps(miss, _mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_LT_OQ), _mm256_cmp_ps(u, one, _CMP_GT_OQ)));
+	miss = _mm256_or_ps(miss, _mm256_or_ps(_mm256_cmp_ps(v, zero, _CMP_LT_OQ), _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_GT_OQ)));
+	__m256 hit = _mm256_andnot_ps(miss, _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+
+	_mm256_storeu_ps(dists, t);
+	return _mm256_movemask_ps(hit) & ((1 << count) - 1);
+}
+
+#endif
+
+TriangleKernel getTriangleKernel(SIMDLevels::SIMDLevel level) {
+	SIMDLevels::SIMDLevel supportedLevel = getSupportedSIMDLevel();
+	if (level > supportedLevel) level = supportedLevel;
+	switch (level) {
+#if SIMD_X86
+	case SIMDLevels::avx2: return TriangleKernel{ rayTrianglesIntersectionAVX2, 8, SIMDLevels::avx2 };
+	case SIMDLevels::sse:  return TriangleKernel{ rayTrianglesIntersectionSSE, 4, SIMDLevels::sse };
+#endif
+	default:               return TriangleKernel{ rayTrianglesIntersectionScalar, MAX_KERNEL_WIDTH, SIMDLevels::scalar };
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include "simd.h"
+
+struct Vec3;
+struct TriangleArrays;
+
+// Most triangles any kernel tests at once. Triangle arrays are padded by this much so
+// that a kernel can always load a full set of lanes past the last triangle
+static constexpr int MAX_KERNEL_WIDTH = 8;
+// Triangles facing away from the ray, or seen almost edge-on, are never hit
+static constexpr float MIN_DETERMINANT = 0.00001f;
+
+// Test a ray against 'count' (at most the kernel's width) consecutive triangles starting at 'first'.
+// Each triangle's hit distance is written to 'dists', and a bitmask is returned of the triangles
+// hit in front of the ray origin, with bit i set for triangle first + i
+typedef int (*RayTrianglesKernel)(
+	const TriangleArrays& triangles,
+	uint32_t first,
+	int count,
+	const Vec3& rayOrigin,
+	const Vec3& rayDirection,
+	float* dists);
+
+struct TriangleKernel {
+	RayTrianglesKernel function;
+	int width;
+	SIMDLevels::SIMDLevel level;
+};
+
+int rayTrianglesIntersectionScalar(const TriangleArrays& triangles, uint32_t first, int count, const Vec3& rayOrigin, const Vec3& rayDirection, float* dists);
+#if SIMD_X86
+int rayTrianglesIntersectionSSE(const TriangleArrays& triangles, uint32_t first, int count, const Vec3& rayOrigin, const Vec3& rayDirection, float* dists);
+int rayTrianglesIntersectionAVX2(const TriangleArrays& triangles, uint32_t first, int count, const Vec3& rayOrigin, const Vec3& rayDirection, float* dists);
+#endif
+
+// Kernel for the given instruction set, falling back to narrower ones the CPU does support
+TriangleKernel getTriangleKernel(SIMDLevels::SIMDLevel level);
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <algorithm>
+#include "geometry.h"
+#include "simd.h"
+
+// Four floats held in one SSE or NEON register where the target has them, and in a plain array
+// otherwise, so that whole vectors are added, multiplied and compared in single instructions. A Vec3
+// becomes one with a fourth component of zero. Every operation rounds exactly as the matching Vec3
+// or std::min/max one does, so code can move between the two without changing any of its results
+struct Vec4 {
+#if SIMD_X86
+	__m128 v;
+	explicit Vec4(__m128 _v);
+#elif SIMD_NEON
+	float32x4_t v;
+	explicit Vec4(float32x4_t _v);
+#else
+	float v[4];
+#endif
+
+	Vec4(float x = 0.0f, float y = 0.0f, float z = 0.0f, float w = 0.0f);
+	explicit Vec4(const Vec3& other);
+	static Vec4 broadcast(float value);
+	// Load and store four consecutive floats, which don't need to be aligned
+	static Vec4 load(const float* values);
+	void store(float* values) const;
+
+	float getX() const;
+	float getY() const;
+	float getZ() const;
+	float getW() const;
+	Vec3 toVec3() const;
+	Vec4 operator+(const Vec4& other) const;
+	Vec4 operator-(const Vec4& other) const;
+	Vec4 operator*(const Vec4& other) const;
+	Vec4 operator*(const float other) const;
+	Vec4 operator/(const Vec4& other) const;
+	// Component-wise minimum and maximum, giving the same result as std::min and std::max for each
+	// pair of components, including when one is NaN, so slab tests miss and hit the same boxes
+	Vec4 min(const Vec4& other) const;
+	Vec4 max(const Vec4& other) const;
+	// Dot and cross products of the first three components, as for Vec3
+	float dot3(const Vec4& other) const;
+	Vec4 cross3(const Vec4& other) const;
+};
+
+#if SIMD_X86
+
+// ------------------------------- //
+//               SSE               //
+// ------------------------------- //
+
+// Constructor from a register
+inline Vec4::Vec4(__m128 _v)
+	: v(_v) {
+}
+// Default constructor
+inline Vec4::Vec4(float x, float y, float z, float w)
+	: v(_mm_setr_ps(x, y, z, w)) {
+}
+// Constructor from a 3D vector
+inline Vec4::Vec4(const Vec3& other)
+	: v(_mm_setr_ps(other.x, other.y, other.z, 0.0f)) {
+}
+// Vector with every component set to the same value
+inline Vec4 Vec4::broadcast(float value) {
+	return Vec4(_mm_set1_ps(value));
+}
+// Load four floats
+inline Vec4 Vec4::load(const float* values) {
+	return Vec4(_mm_loadu_ps(values));
+}
+// Store four floats
+inline void Vec4::store(float* values) const {
+	_mm_storeu_ps(values, v);
+}
+// Get each component
+inline float Vec4::getX() const {
+	return _mm_cvtss_f32(v);
+}
+inline float Vec4::getY() const {
+	return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+}
+inline float Vec4::getZ() const {
+	return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)));
+}
+inline float Vec4::getW() const {
+	return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)));
+}
+// Arithmetic operators
+inline Vec4 Vec4::operator+(const Vec4& other) const {
+	return Vec4(_mm_add_ps(v, other.v));
+}
+inline Vec4 Vec4::operator-(const Vec4& other) const {
+	return Vec4(_mm_sub_ps(v, other.v));
+}
+inline Vec4 Vec4::operator*(const Vec4& other) const {
+	return Vec4(_mm_mul_ps(v, other.v));
+}
+inline Vec4 Vec4::operator*(const float other) const {
+	return Vec4(_mm_mul_ps(v, _mm_set1_ps(other)));
+}
+inline Vec4 Vec4::operator/(const Vec4& other) const {
+	return Vec4(_mm_div_ps(v, other.v));
+}
+// SSE returns its second operand unless the first is strictly smaller (or larger), which is
+// std::min (or std::max) with its operands swapped
+inline Vec4 Vec4::min(const Vec4& other) const {
+	return Vec4(_mm_min_ps(other.v, v));
+}
+inline Vec4 Vec4::max(const Vec4& other) const {
+	return Vec4(_mm_max_ps(other.v, v));
+}
+// Cross product, with the components rotated into place by shuffles
+inline Vec4 Vec4::cross3(const Vec4& other) const {
+	__m128 yzx = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 zxy = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 1, 0, 2));
+	__m128 otherYzx = _mm_shuffle_ps(other.v, other.v, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 otherZxy = _mm_shuffle_ps(other.v, other.v, _MM_SHUFFLE(3, 1, 0, 2));
+	return Vec4(_mm_sub_ps(_mm_mul_ps(yzx, otherZxy), _mm_mul_ps(zxy, otherYzx)));
+}
+
+#elif SIMD_NEON
+
+// -------------------------------- //
+//               NEON               //
+// -------------------------------- //
+
+// Constructor from a register
+inline Vec4::Vec4(float32x4_t _v)
+	: v(_v) {
+}
+// Default constructor
+inline Vec4::Vec4(float x, float y, float z, float w) {
+	const float values[4] = { x, y, z, w };
+	v = vld1q_f32(values);
+}
+// Constructor from a 3D vector
+inline Vec4::Vec4(const Vec3& other)
+	: Vec4(other.x, other.y, other.z, 0.0f) {
+}
+// Vector with every component set to the same value
+inline Vec4 Vec4::broadcast(float value) {
+	return Vec4(vdupq_n_f32(value));
+}
+// Load four floats
+inline Vec4 Vec4::load(const float* values) {
+	return Vec4(vld1q_f32(values));
+}
+// Store four floats
+inline void Vec4::store(float* values) const {
+	vst1q_f32(values, v);
+}
+// Get each component
+inline float Vec4::getX() const {
+	return vgetq_lane_f32(v, 0);
+}
+inline float Vec4::getY() const {
+	return vgetq_lane_f32(v, 1);
+}
+inline float Vec4::getZ() const {
+	return vgetq_lane_f32(v, 2);
+}
+inline float Vec4::getW() const {
+	return vgetq_lane_f32(v, 3);
+}
+// Arithmetic operators
+inline Vec4 Vec4::operator+(const Vec4& other) const {
+	return Vec4(vaddq_f32(v, other.v));
+}
+inline Vec4 Vec4::operator-(const Vec4& other) const {
+	return Vec4(vsubq_f32(v, other.v));
+}
+inline Vec4 Vec4::operator*(const Vec4& other) const {
+	return Vec4(vmulq_f32(v, other.v));
+}
+inline Vec4 Vec4::operator*(const float other) const {
+	return Vec4(vmulq_n_f32(v, other));
+}
+inline Vec4 Vec4::operator/(const Vec4& other) const {
+	return Vec4(vdivq_f32(v, other.v));
+}
+// NEON's own minimum and maximum return NaN if either operand is, so they are built from a
+// comparison and a select instead, to pick the same operand as std::min and std::max
+inline Vec4 Vec4::min(const Vec4& other) const {
+	return Vec4(vbslq_f32(vcltq_f32(other.v, v), other.v, v));
+}
+inline Vec4 Vec4::max(const Vec4& other) const {
+	return Vec4(vbslq_f32(vcltq_f32(v, other.v), other.v, v));
+}
+// Cross product. NEON has no general shuffle, so the components are rearranged one at a time
+inline Vec4 Vec4::cross3(const Vec4& other) const {
+	return Vec4(toVec3().cross(other.toVec3()));
+}
+
+#else
+
+// ------------------------------- //
+//              Scalar             //
+// ------------------------------- //
+
+// Default constructor
+inline Vec4::Vec4(float x, float y, float z, float w)
+	: v{ x, y, z, w } {
+}
+// Constructor from a 3D vector
+inline Vec4::Vec4(const Vec3& other)
+	: v{ other.x, other.y, other.z, 0.0f } {
+}
+// Vector with every component set to the same value
+inline Vec4 Vec4::broadcast(float value) {
+	return Vec4(value, value, value, value);
+}
+// Load four floats
+inline Vec4 Vec4::load(const float* values) {
+	return Vec4(values[0], values[1], values[2], values[3]);
+}
+// Store four floats
+inline void Vec4::store(float* values) const {
+	std::copy(v, v + 4, values);
+}
+// Get each component
+inline float Vec4::getX() const {
+	return v[0];
+}
+inline float Vec4::getY() const {
+	return v[1];
+}
+inline float Vec4::getZ() const {
+	return v[2];
+}
+inline float Vec4::getW() const {
+	return v[3];
+}
+// Arithmetic operators
+inline Vec4 Vec4::operator+(const Vec4& other) const {
+	return Vec4(v[0] + other.v[0], v[1] + other.v[1], v[2] + other.v[2], v[3] + other.v[3]);
+}
+inline Vec4 Vec4::operator-(const Vec4& other) const {
+	return Vec4(v[0] - other.v[0], v[1] - other.v[1], v[2] - other.v[2], v[3] - other.v[3]);
+}
+inline Vec4 Vec4::operator*(const Vec4& other) const {
+	return Vec4(v[0] * other.v[0], v[1] * other.v[1], v[2] * other.v[2], v[3] * other.v[3]);
+}
+inline Vec4 Vec4::operator*(const float other) const {
+	return Vec4(v[0] * other, v[1] * other, v[2] * other, v[3] * other);
+}
+inline Vec4 Vec4::operator/(const Vec4& other) const {
+	return Vec4(v[0] / other.v[0], v[1] / other.v[1], v[2] / other.v[2], v[3] / other.v[3]);
+}
+// Component-wise minimum and maximum
+inline Vec4 Vec4::min(const Vec4& other) const {
+	return Vec4(std::min(v[0], other.v[0]), std::min(v[1], other.v[1]), std::min(v[2], other.v[2]), std::min(v[3], other.v[3]));
+}
+inline Vec4 Vec4::max(const Vec4& other) const {
+	return Vec4(std::max(v[0], other.v[0]), std::max(v[1], other.v[1]), std::max(v[2], other.v[2]), std::max(v[3], other.v[3]));
+}
+// Cross product
+inline Vec4 Vec4::cross3(const Vec4& other) const {
+	return Vec4(toVec3().cross(other.toVec3()));
+}
+
+#endif
+
+// ----------------------------------------------- //
+//               Shared by every target            //
+// ----------------------------------------------- //
+
+// Get the first three components as a 3D vector
+inline Vec3 Vec4::toVec3() const {
+	return Vec3(getX(), getY(), getZ());
+}
+// Dot product, adding the products in the same order as Vec3 does
+inline float Vec4::dot3(const Vec4& other) const {
+	Vec4 product = *this * other;
+	return product.getX() + product.getY() + product.getZ();
+}